@@ -98,6 +98,15 @@ extern "C" {
 #define P3_CHR_SIZE_256                     0x40000
 #define P3_CHR_SIZE_512                     0x80000
 #define P3_CHR_SIZE_1024                    0x100000
+/* Any whole number of 8 KB banks up to P3_CHR_SIZE_MAX is accepted */
+#define P3_CHR_SIZE_MAX                     0x7FFFE000
+
+/* Size of buffer always enough for CHR pack of tileset, see p3_pack_chr() */
+#define P3_PACK_BOUND(chr_size)             (8 + ((chr_size) / 0x2000 + 1) * 4 + (chr_size))
+
+/* Minimal number of resident banks of paged tileset, each of 16 windows
+   of mapper may select own bank */
+#define P3_MIN_RESIDENT_BANKS               17
 
 /* Pattern tables */
 #define P3_CHR_TABLE_LEFT                   0
@@ -107,14 +116,16 @@ extern "C" {
 #define P3_CHR_TABLE_PPU                    4
 #define P3_CHR_TABLE_MAIN                   5
 
-/* Banking modes */
+/* Banking modes, P3_CHR_TABLE_PPU sets mode of both pattern tables and
+   numbers their banks in order, P3_MMC_MODE_1X4 gives 8 banks of 1 KB */
 #define P3_MMC_MODE_4X1                     0
 #define P3_MMC_MODE_2X2                     1
 #define P3_MMC_MODE_211                     2
 #define P3_MMC_MODE_112                     3
 #define P3_MMC_MODE_1X4                     4
+#define P3_MMC_MODE_05X8                    5
 
-/* Start address of bank */
+/* Start address of bank, P3_MMC_MODE_05X8 takes number of 512-byte bank */
 #define P3_BANK_0K                          0
 #define P3_BANK_1K                          1
 #define P3_BANK_2K                          2
@@ -159,6 +170,9 @@ extern "C" {
 #define P3_ATTRIBUTE_BOTTOM_LEFT            2
 #define P3_ATTRIBUTE_BOTTOM_RIGHT           3
 
+/* Extended attribute of tile: palette and 4 KB bank of tileset */
+#define P3_EXT_ATTRIBUTE(pal, bank4k)       ((((pal) & 3) << 6) | ((bank4k) & 0x3F))
+
 /* Flags for p3_reset() */
 #define P3_RESET_NAMETABLES                 (1 << 0)
 #define P3_RESET_ATTRIBUTTES                (1 << 1)
@@ -227,6 +241,31 @@ extern "C" {
 #define P3_SPRITE_FRONT                     0
 #define P3_SPRITE_BEHIND                    1
 
+/* Fields of raster table entry to apply */
+#define P3_RASTER_SCROLL_X                  (1 << 0)
+#define P3_RASTER_SCROLL_Y                  (1 << 1)
+#define P3_RASTER_PAGE                      (1 << 2)
+#define P3_RASTER_BG_CHR_TABLE              (1 << 3)
+#define P3_RASTER_OBJ_CHR_TABLE             (1 << 4)
+#define P3_RASTER_SHOW                      (1 << 5)
+#define P3_RASTER_CLIP                      (1 << 6)
+#define P3_RASTER_PALETTE                   (1 << 7)
+
+/* Pixel formats of RGB output. Palette of RGB output is NULL for built-in
+   palette or 512 colors 0xRRGGBB, one for each pixel value */
+#define P3_FORMAT_RGBA8888                  0
+#define P3_FORMAT_BGRA8888                  1
+#define P3_FORMAT_RGB565                    2
+
+/* Size of changed rows mask, bit per scanline */
+#define P3_CHANGE_MASK_SIZE                 30
+
+/* SIMD level of scanline compositor, shared by all objects. Level must not
+   be changed by p3_set_simd_level() while any object is rendering */
+#define P3_SIMD_NONE                        0
+#define P3_SIMD_SSE2                        1
+#define P3_SIMD_AVX2                        2
+
 /* One of 64 sprites */
 typedef struct p3_sprite {
 	unsigned char x;
@@ -238,19 +277,62 @@ typedef struct p3_sprite {
 	unsigned char flip_vertical;	
 } P3_SPRITE;
 
-/* Render callback function */
+/* Raster table entry, one per scanline. Fields selected by flags are applied
+   before scanline is rendered and kept for next scanlines until end of frame.
+   Scroll is relative to frame: scanline y shows row scroll_y + y of page.
+   Raster table isn't used when render callback is enabled */
+typedef struct p3_raster_line {
+	unsigned short flags;
+	unsigned char scroll_x;
+	unsigned char scroll_y;
+	unsigned char page;
+	unsigned char bg_chr_table;
+	unsigned char obj_chr_table;
+	unsigned char show_bg;
+	unsigned char show_obj;
+	unsigned char clip_bg;
+	unsigned char clip_obj;
+	unsigned char palette_index;	/* first palette entry to write */
+	unsigned char palette_count;	/* 0..8 */
+	unsigned char palette[8];
+} P3_RASTER_LINE;
+
+/* Changed region of frame */
+typedef struct p3_rect {
+	int x, y;
+	int width, height;
+} P3_RECT;
+
+/* Render callback function. Raster events registered by p3_add_raster_event()
+   are called before pixel (x, y) is rendered when render callback is enabled */
 typedef void (*P3_CALLBACK)(int x, int y, void *param);
 /* P3 instance */
 typedef struct p3_object P3_OBJECT;
+/* Called when frame of batch object is rendered, index is position of
+   object in batch. Object is current object of calling thread */
+typedef void (*P3_BATCH_CALLBACK)(P3_OBJECT *obj, int index, void *param);
+/* Loads 8 KB bank of paged tileset to 'dst', returns 0 if bank can't be loaded */
+typedef int (*P3_BANK_LOADER)(void *dst, int bank8k, void *param);
 
 /* P3 object functions */
 P3_OBJECT *p3_create_object(void *chr, int chr_size);
+P3_OBJECT *p3_create_object_from_file(const char *path);
+P3_OBJECT *p3_create_object_paged(int chr_size, int resident_banks, P3_BANK_LOADER loader, void *param);
+P3_OBJECT *p3_create_object_from_pack(const char *path, int resident_banks);
+int p3_pack_chr(void *dst, int dst_size, const void *chr, int chr_size);
 void p3_destroy_object(P3_OBJECT **obj);
 void p3_select_object(P3_OBJECT *obj);
+void p3_select_thread_object(P3_OBJECT *obj);
 P3_OBJECT *p3_get_current_object(void);
 P3_OBJECT *p3_clone_object(P3_OBJECT *obj);
 void p3_copy_object(P3_OBJECT *dst, P3_OBJECT *src);
 
+/* Batch rendering functions. Batches may be rendered from several threads,
+   one batch at a time uses pool, others render on calling thread */
+void p3_render_batch(P3_OBJECT **objects, int num, P3_BATCH_CALLBACK proc, void *param);
+void p3_set_render_pool(int nthreads, const int *cpus);
+int p3_get_render_pool_size(void);
+
 /* Tileset functions */
 void *p3_get_chr_ptr(void);
 void p3_set_chr_ptr(void *chr, int chr_size);
@@ -261,6 +343,17 @@ void p3_put_tile(int index, const void *tile);
 void p3_copy_tiles(int dst, int src, int num, int b_mapdst, int b_mapsrc);
 void p3_read_tiles(void *buf, int start, int num, int b_usemmc);
 void p3_write_tiles(const void *tiles, int start, int num, int b_usemmc);
+int p3_is_tile_cache_enabled(void);
+void p3_enable_tile_cache(int flag);
+int p3_get_dirty_tile_count(void);
+int p3_is_tile_dirty(int index);
+int p3_find_dirty_tile(int start);
+void p3_read_dirty_tiles(void *buf);
+void p3_mark_dirty_tiles(int start, int num);
+void p3_clear_dirty_tiles(int start, int num);
+int p3_is_bg_plane_enabled(void);
+void p3_enable_bg_plane(int flag);
+int p3_get_bank_faults(void);
 
 /* Mapper functions */
 int p3_get_mmc_mode(int table);
@@ -351,9 +444,36 @@ P3_CALLBACK p3_get_callback(void);
 void p3_set_callback(P3_CALLBACK proc, int type, int once_x, int once_y, void *param);
 void p3_adjust_callback(int type, int once_x, int once_y);
 void p3_reset_callback(void);
+const P3_RASTER_LINE *p3_get_raster_table(void);
+void p3_set_raster_table(const P3_RASTER_LINE *table);
+int p3_get_raster_event_count(void);
+void p3_add_raster_event(int x, int y, P3_CALLBACK proc, void *param);
+void p3_clear_raster_events(void);
 void p3_refetch_tile(void);
-void p3_render(void);
+int p3_render(void);
+int p3_render_parallel(int nthreads);
+void p3_touch(void);
+/* Render frame by parts. Without render callback, scroll, page, CHR table
+   selection, show and clip flags, palette, tint and grayscale are latched at
+   p3_render_begin() (raster table entries change latched copy). Nametables,
+   attributes, ext attributes, CHR data and mapping, sprites and raster table
+   entries are read live by each p3_render_lines(), writes between calls show
+   on lines rendered after them. With render callback, all state is read live.
+   Frame is finished and object is idle again after p3_render_end() */
+void p3_render_begin(void);
+void p3_render_lines(int num);
+void p3_render_end(void);
+int p3_get_rendered_lines(void);
+void p3_render_rgb(void *dst, int stride, int format, const void *palette);
 const void *p3_get_frame_pointer(void);
+int p3_is_change_tracking_enabled(void);
+void p3_enable_change_tracking(int flag);
+void p3_get_changed_rows(void *mask);
+int p3_get_changed_rects(P3_RECT *rects, int count);
+void p3_set_render_target(void *ptr, int stride, int x, int y);
+int p3_get_simd_level(void);
+void p3_set_simd_level(int level);
+void p3_convert_frame(void *dst, int stride, int format, const void *palette, const void *src);
 
 /* Tile utils */
 void p3_fill_tile(void *tile, int color);
@@ -429,6 +549,217 @@ int p3_set_attribute_byte_item(int attr, int pos, int pal);
 int p3_get_attribute_byte_item_x(int attr);
 int p3_set_attribute_byte_item_x(int attr, int pal);
 
+/* Extended attributes */
+int p3_is_ext_attributes_enabled(void);
+void p3_enable_ext_attributes(int flag);
+int p3_get_ext_attribute_2t(int page, int x, int y);
+void p3_put_ext_attribute_2t(int page, int x, int y, int ext);
+void p3_read_ext_attributes(int page, void *buf);
+void p3_write_ext_attributes(int page, const void *data);
+void p3_fill_ext_attributes(int page, int ext);
+
+/* Explicit object API, p3x_name(p3, ...) works as p3_name(...) on p3
+   without selecting it, objects may be used by different threads */
+
+/* Tileset functions of object */
+void *p3x_get_chr_ptr(P3_OBJECT *p3);
+void p3x_set_chr_ptr(P3_OBJECT *p3, void *chr, int chr_size);
+int p3x_get_chr_size(P3_OBJECT *p3);
+int p3x_get_tile_count(P3_OBJECT *p3);
+void *p3x_get_tile(P3_OBJECT *p3, int index);
+void p3x_put_tile(P3_OBJECT *p3, int index, const void *tile);
+void p3x_copy_tiles(P3_OBJECT *p3, int dst, int src, int num, int b_mapdst, int b_mapsrc);
+void p3x_read_tiles(P3_OBJECT *p3, void *buf, int start, int num, int b_usemmc);
+void p3x_write_tiles(P3_OBJECT *p3, const void *tiles, int start, int num, int b_usemmc);
+int p3x_is_tile_cache_enabled(P3_OBJECT *p3);
+void p3x_enable_tile_cache(P3_OBJECT *p3, int flag);
+int p3x_get_dirty_tile_count(P3_OBJECT *p3);
+int p3x_is_tile_dirty(P3_OBJECT *p3, int index);
+int p3x_find_dirty_tile(P3_OBJECT *p3, int start);
+void p3x_read_dirty_tiles(P3_OBJECT *p3, void *buf);
+void p3x_mark_dirty_tiles(P3_OBJECT *p3, int start, int num);
+void p3x_clear_dirty_tiles(P3_OBJECT *p3, int start, int num);
+int p3x_is_bg_plane_enabled(P3_OBJECT *p3);
+void p3x_enable_bg_plane(P3_OBJECT *p3, int flag);
+int p3x_get_bank_faults(P3_OBJECT *p3);
+
+/* Mapper functions of object */
+int p3x_get_mmc_mode(P3_OBJECT *p3, int table);
+void p3x_set_mmc_mode(P3_OBJECT *p3, int table, int mode);
+int p3x_get_bank(P3_OBJECT *p3, int table, int bank_adr);
+void p3x_set_bank(P3_OBJECT *p3, int table, int bank_adr, int num);
+void p3x_reset_table_banks(P3_OBJECT *p3, int table);
+void p3x_reset_banks(P3_OBJECT *p3);
+void p3x_setup_banks(P3_OBJECT *p3, int bank8k);
+int p3x_get_last_banks_setup(P3_OBJECT *p3);
+int p3x_map_address(P3_OBJECT *p3, int address);
+int p3x_map_tile(P3_OBJECT *p3, int index);
+int p3x_get_mirroring_type(P3_OBJECT *p3);
+void p3x_set_mirroring_type(P3_OBJECT *p3, int type);
+void p3x_get_mirroring_lut(P3_OBJECT *p3, int lut[4]);
+void p3x_set_mirroring_lut(P3_OBJECT *p3, const int lut[4]);
+void p3x_set_mirroring_lut_4(P3_OBJECT *p3, int tl, int tr, int bl, int br);
+int p3x_mirror_page(P3_OBJECT *p3, int page);
+
+/* P3 functions of object */
+int p3x_is_enabled(P3_OBJECT *p3);
+void p3x_enable(P3_OBJECT *p3, int flag);
+void p3x_reset(P3_OBJECT *p3, int flags);
+int p3x_is_show_bg(P3_OBJECT *p3);
+void p3x_show_bg(P3_OBJECT *p3, int flag);
+int p3x_is_show_obj(P3_OBJECT *p3);
+void p3x_show_obj(P3_OBJECT *p3, int flag);
+int p3x_is_clip_bg(P3_OBJECT *p3);
+void p3x_clip_bg(P3_OBJECT *p3, int flag);
+int p3x_is_clip_obj(P3_OBJECT *p3);
+void p3x_clip_obj(P3_OBJECT *p3, int flag);
+int p3x_is_grayscale(P3_OBJECT *p3);
+void p3x_enable_grayscale(P3_OBJECT *p3, int flag);
+int p3x_get_tint(P3_OBJECT *p3);
+void p3x_set_tint(P3_OBJECT *p3, int tint);
+int p3x_get_obj_mode(P3_OBJECT *p3);
+void p3x_set_obj_mode(P3_OBJECT *p3, int mode);
+int p3x_get_bg_chr_table(P3_OBJECT *p3);
+void p3x_set_bg_chr_table(P3_OBJECT *p3, int table);
+int p3x_get_obj_chr_table(P3_OBJECT *p3);
+void p3x_set_obj_chr_table(P3_OBJECT *p3, int table);
+int p3x_get_page(P3_OBJECT *p3);
+void p3x_set_page(P3_OBJECT *p3, int page);
+int p3x_get_scroll_x(P3_OBJECT *p3);
+void p3x_set_scroll_x(P3_OBJECT *p3, int value);
+int p3x_get_scroll_y(P3_OBJECT *p3);
+void p3x_set_scroll_y(P3_OBJECT *p3, int value);
+void p3x_set_scroll(P3_OBJECT *p3, int x, int y);
+void p3x_write_obj(P3_OBJECT *p3, const P3_SPRITE *obj);
+P3_SPRITE p3x_get_sprite(P3_OBJECT *p3, int index);
+void p3x_put_sprite(P3_OBJECT *p3, int index, const P3_SPRITE *sprite);
+void p3x_reset_sprite(P3_OBJECT *p3, int index);
+int p3x_is_sprite_overflow(P3_OBJECT *p3);
+int p3x_is_fix_obj_y(P3_OBJECT *p3);
+void p3x_fix_obj_y(P3_OBJECT *p3, int flag);
+void p3x_read_palette(P3_OBJECT *p3, void *buf, int b_bg);
+void p3x_write_palette(P3_OBJECT *p3, const void *pal, int b_bg);
+int p3x_get_color(P3_OBJECT *p3, int index);
+void p3x_set_color(P3_OBJECT *p3, int idx, int col);
+int p3x_get_palette_color(P3_OBJECT *p3, int pal, int col);
+void p3x_set_palette_color(P3_OBJECT *p3, int pal, int col, int val);
+int p3x_get_canvas_color(P3_OBJECT *p3);
+void p3x_set_canvas_color(P3_OBJECT *p3, int color);
+int p3x_get_bg_color(P3_OBJECT *p3, int pal, int col);
+void p3x_set_bg_color(P3_OBJECT *p3, int pal, int col, int val);
+int p3x_get_obj_color(P3_OBJECT *p3, int pal, int col);
+void p3x_set_obj_color(P3_OBJECT *p3, int pal, int col, int val);
+int p3x_get_register(P3_OBJECT *p3, int reg);
+void p3x_set_register(P3_OBJECT *p3, int reg, int value);
+void p3x_update_register(P3_OBJECT *p3, int reg);
+void p3x_save_register(P3_OBJECT *p3, int reg);
+void p3x_restore_register(P3_OBJECT *p3, int reg);
+int p3x_get_increment(P3_OBJECT *p3);
+void p3x_set_increment(P3_OBJECT *p3, int inc);
+int p3x_get_address(P3_OBJECT *p3);
+void p3x_set_address(P3_OBJECT *p3, int adr);
+int p3x_get_byte(P3_OBJECT *p3);
+void p3x_put_byte(P3_OBJECT *p3, int value);
+int p3x_get_byte_at(P3_OBJECT *p3, int adr);
+void p3x_put_byte_at(P3_OBJECT *p3, int adr, int val);
+void p3x_read(P3_OBJECT *p3, void *dst, int num);
+void p3x_write(P3_OBJECT *p3, const void *src, int num);
+void p3x_fill(P3_OBJECT *p3, int val, int num);
+void *p3x_get_v_pointer(P3_OBJECT *p3);
+int p3x_is_callback_enabled(P3_OBJECT *p3);
+void p3x_enable_callback(P3_OBJECT *p3, int flag);
+P3_CALLBACK p3x_get_callback(P3_OBJECT *p3);
+void p3x_set_callback(P3_OBJECT *p3, P3_CALLBACK proc, int type, int once_x, int once_y, void *param);
+void p3x_adjust_callback(P3_OBJECT *p3, int type, int once_x, int once_y);
+void p3x_reset_callback(P3_OBJECT *p3);
+const P3_RASTER_LINE *p3x_get_raster_table(P3_OBJECT *p3);
+void p3x_set_raster_table(P3_OBJECT *p3, const P3_RASTER_LINE *table);
+int p3x_get_raster_event_count(P3_OBJECT *p3);
+void p3x_add_raster_event(P3_OBJECT *p3, int x, int y, P3_CALLBACK proc, void *param);
+void p3x_clear_raster_events(P3_OBJECT *p3);
+void p3x_refetch_tile(P3_OBJECT *p3);
+int p3x_render(P3_OBJECT *p3);
+int p3x_render_parallel(P3_OBJECT *p3, int nthreads);
+void p3x_touch(P3_OBJECT *p3);
+void p3x_render_begin(P3_OBJECT *p3);
+void p3x_render_lines(P3_OBJECT *p3, int num);
+void p3x_render_end(P3_OBJECT *p3);
+int p3x_get_rendered_lines(P3_OBJECT *p3);
+void p3x_render_rgb(P3_OBJECT *p3, void *dst, int stride, int format, const void *palette);
+const void *p3x_get_frame_pointer(P3_OBJECT *p3);
+int p3x_is_change_tracking_enabled(P3_OBJECT *p3);
+void p3x_enable_change_tracking(P3_OBJECT *p3, int flag);
+void p3x_get_changed_rows(P3_OBJECT *p3, void *mask);
+int p3x_get_changed_rects(P3_OBJECT *p3, P3_RECT *rects, int count);
+void p3x_set_render_target(P3_OBJECT *p3, void *ptr, int stride, int x, int y);
+
+/* Tile utils of object */
+int p3x_make_tile_index_1m(P3_OBJECT *p3, int index);
+int p3x_make_tile_index_1t(P3_OBJECT *p3, int table, int index);
+int p3x_make_tile_index_1tm(P3_OBJECT *p3, int table, int index);
+int p3x_make_tile_index_2(P3_OBJECT *p3, int x, int y);
+int p3x_make_tile_index_2m(P3_OBJECT *p3, int x, int y);
+int p3x_make_tile_index_2t(P3_OBJECT *p3, int table, int x, int y);
+int p3x_make_tile_index_2tm(P3_OBJECT *p3, int table, int x, int y);
+
+/* Page utils of object */
+void p3x_zero_page(P3_OBJECT *p3, int page);
+void p3x_fill_page(P3_OBJECT *p3, int page, int tile, int pal);
+void p3x_read_page(P3_OBJECT *p3, int page, void *buf);
+void p3x_write_page(P3_OBJECT *p3, int page, const void *data);
+
+/* Nametable utils of object */
+void p3x_fill_nametable(P3_OBJECT *p3, int page, int tile);
+void p3x_zero_nametable(P3_OBJECT *p3, int page);
+void p3x_fill_nametable_row_2(P3_OBJECT *p3, int page, int row, int tile, int start, int end);
+void p3x_fill_nametable_row(P3_OBJECT *p3, int page, int row, int tile);
+void p3x_fill_nametable_column_2(P3_OBJECT *p3, int page, int col, int tile, int start, int end);
+void p3x_fill_nametable_column(P3_OBJECT *p3, int page, int col, int tile);
+void p3x_read_nametable(P3_OBJECT *p3, int page, void *buf);
+void p3x_write_nametable(P3_OBJECT *p3, int page, const void *data);
+int p3x_get_name(P3_OBJECT *p3, int index);
+void p3x_put_name(P3_OBJECT *p3, int index, int tile);
+int p3x_get_name_1t(P3_OBJECT *p3, int page, int index);
+void p3x_put_name_1t(P3_OBJECT *p3, int page, int index, int tile);
+int p3x_get_name_2(P3_OBJECT *p3, int x, int y);
+void p3x_put_name_2(P3_OBJECT *p3, int x, int y, int tile);
+int p3x_get_name_2t(P3_OBJECT *p3, int page, int x, int y);
+void p3x_put_name_2t(P3_OBJECT *p3, int page, int x, int y, int tile);
+
+/* Attribute table utils of object */
+void p3x_fill_attribute_table(P3_OBJECT *p3, int page, int pal);
+void p3x_zero_attribute_table(P3_OBJECT *p3, int page);
+void p3x_fill_attribute_table_row_2(P3_OBJECT *p3, int page, int row, int pal, int start, int end);
+void p3x_fill_attribute_table_row(P3_OBJECT *p3, int page, int row, int pal);
+void p3x_fill_attribute_table_column_2(P3_OBJECT *p3, int page, int col, int pal, int start, int end);
+void p3x_fill_attribute_table_column(P3_OBJECT *p3, int page, int col, int pal);
+void p3x_read_attribute_table(P3_OBJECT *p3, int page, void *buf);
+void p3x_write_attribute_table(P3_OBJECT *p3, int page, const void *data);
+int p3x_get_attribute_position(P3_OBJECT *p3);
+int p3x_make_attribute_address(P3_OBJECT *p3, int index);
+int p3x_make_attribute_address_1t(P3_OBJECT *p3, int page, int index);
+int p3x_make_attribute_address_2(P3_OBJECT *p3, int x, int y);
+int p3x_make_attribute_address_2t(P3_OBJECT *p3, int page, int x, int y);
+int p3x_get_attribute(P3_OBJECT *p3, int index);
+void p3x_put_attribute(P3_OBJECT *p3, int index, int pal);
+int p3x_get_attribute_1t(P3_OBJECT *p3, int page, int index);
+void p3x_put_attribute_1t(P3_OBJECT *p3, int page, int index, int pal);
+int p3x_get_attribute_2(P3_OBJECT *p3, int x, int y);
+void p3x_put_attribute_2(P3_OBJECT *p3, int x, int y, int pal);
+int p3x_get_attribute_2t(P3_OBJECT *p3, int page, int x, int y);
+void p3x_put_attribute_2t(P3_OBJECT *p3, int page, int x, int y, int pal);
+int p3x_get_attribute_byte_item_x(P3_OBJECT *p3, int attr);
+int p3x_set_attribute_byte_item_x(P3_OBJECT *p3, int attr, int pal);
+
+/* Extended attributes of object */
+int p3x_is_ext_attributes_enabled(P3_OBJECT *p3);
+void p3x_enable_ext_attributes(P3_OBJECT *p3, int flag);
+int p3x_get_ext_attribute_2t(P3_OBJECT *p3, int page, int x, int y);
+void p3x_put_ext_attribute_2t(P3_OBJECT *p3, int page, int x, int y, int ext);
+void p3x_read_ext_attributes(P3_OBJECT *p3, int page, void *buf);
+void p3x_write_ext_attributes(P3_OBJECT *p3, int page, const void *data);
+void p3x_fill_ext_attributes(P3_OBJECT *p3, int page, int ext);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -21,6 +21,9 @@
 #include "p3.h"
 #include "common.h"
 
+/* bg_plane.c module */
+void g_invalidate_bg_plane(P3_OBJECT *obj);
+
 USE_P3_OBJECT;
 
 /* Used in p3_set_attribute_byte_item */
@@ -31,17 +34,19 @@ static const byte attribute_reset_mask[4] = {
 	(byte) ~(3 << 6)                        /* P3_ATTRIBUTE_BOTTOM_RIGHT */
 };
 
-void p3_fill_attribute_table(int page, int pal)
+void p3x_fill_attribute_table(P3_OBJECT *p3, int page, int pal)
 {
 	page &= 3;
 	pal &= 3;
-	p3_set_address(page * 1024 + 960);
-	memset(p3_get_v_pointer(), p3_make_flat_attribute_byte(pal), 64);
+	p3x_set_address(p3, page * 1024 + 960);
+	memset(p3x_get_v_pointer(p3), p3_make_flat_attribute_byte(pal), 64);
+	STATE_CHANGED();
+	g_invalidate_bg_plane(p3);
 }
 
-void p3_zero_attribute_table(int page) { p3_fill_attribute_table(page, P3_PALETTE_0); }
+void p3x_zero_attribute_table(P3_OBJECT *p3, int page) { p3x_fill_attribute_table(p3, page, P3_PALETTE_0); }
 
-void p3_fill_attribute_table_row_2(int page, int row, int pal, int start, int end)
+void p3x_fill_attribute_table_row_2(P3_OBJECT *p3, int page, int row, int pal, int start, int end)
 {
 	page &= 3;
 	row &= 15;
@@ -53,16 +58,16 @@ void p3_fill_attribute_table_row_2(int page, int row, int pal, int start, int en
 		end = tmp;
 	}
 	for (; start <= end; ++start) {
-		p3_put_attribute_2t(page, start, row, pal);
+		p3x_put_attribute_2t(p3, page, start, row, pal);
 	}
 }
 
-void p3_fill_attribute_table_row(int page, int row, int pal)
+void p3x_fill_attribute_table_row(P3_OBJECT *p3, int page, int row, int pal)
 {
-	p3_fill_attribute_table_row_2(page, row, pal, 0, 15);
+	p3x_fill_attribute_table_row_2(p3, page, row, pal, 0, 15);
 }
 
-void p3_fill_attribute_table_column_2(int page, int col, int pal, int start, int end)
+void p3x_fill_attribute_table_column_2(P3_OBJECT *p3, int page, int col, int pal, int start, int end)
 {
 	page &= 3;
 	col &= 15;
@@ -74,60 +79,62 @@ void p3_fill_attribute_table_column_2(int page, int col, int pal, int start, int
 		end = tmp;
 	}
 	for (; start <= end; ++start) {
-		p3_put_attribute_2t(page, col, start, pal);
+		p3x_put_attribute_2t(p3, page, col, start, pal);
 	}
 }
 
-void p3_fill_attribute_table_column(int page, int col, int pal)
+void p3x_fill_attribute_table_column(P3_OBJECT *p3, int page, int col, int pal)
 {
-	p3_fill_attribute_table_column_2(page, col, pal, 0, 15);
+	p3x_fill_attribute_table_column_2(p3, page, col, pal, 0, 15);
 }
 
-void p3_read_attribute_table(int page, void *buf)
+void p3x_read_attribute_table(P3_OBJECT *p3, int page, void *buf)
 {
 	if (buf) {
 		page &= 3;
-		p3_set_address(page * 1024 + 960);
-		memcpy(buf, p3_get_v_pointer(), 64);
+		p3x_set_address(p3, page * 1024 + 960);
+		memcpy(buf, p3x_get_v_pointer(p3), 64);
 	} else {
 		set_last_error("p3_read_attribute_table(): bad 'buf' argument");
 	}
 }
 
-void p3_write_attribute_table(int page, const void *data)
+void p3x_write_attribute_table(P3_OBJECT *p3, int page, const void *data)
 {
 	if (data) {
 		page &= 3;
-		p3_set_address(page * 1024 + 960);
-		memcpy(p3_get_v_pointer(), data, 64);
+		p3x_set_address(p3, page * 1024 + 960);
+		memcpy(p3x_get_v_pointer(p3), data, 64);
+		STATE_CHANGED();
+		g_invalidate_bg_plane(p3);
 	} else {
 		set_last_error("p3_write_attribute_table(): bad 'data' argument");
 	}
 }
 
-int p3_get_attribute_position(void) { return S(last_attribute_pos); }
+int p3x_get_attribute_position(P3_OBJECT *p3) { return S(last_attribute_pos); }
 
-int p3_make_attribute_address(int index)
+int p3x_make_attribute_address(P3_OBJECT *p3, int index)
 {
 	index &= 0x3ff;
-	return p3_make_attribute_address_2t(((index >> 8) & 2) | ((index >> 4) & 1),
+	return p3x_make_attribute_address_2t(p3, ((index >> 8) & 2) | ((index >> 4) & 1),
                                     index & 15, (index >> 5) & 15);
 }
 
-int p3_make_attribute_address_1t(int page, int index)
+int p3x_make_attribute_address_1t(P3_OBJECT *p3, int page, int index)
 {
 	index &= 0xff;
-	return p3_make_attribute_address_2t(page, index & 15, index >> 4);
+	return p3x_make_attribute_address_2t(p3, page, index & 15, index >> 4);
 }
 
-int p3_make_attribute_address_2(int x, int y)
+int p3x_make_attribute_address_2(P3_OBJECT *p3, int x, int y)
 {
 	x &= 0x1f;
 	y &= 0x1f;
-	return p3_make_attribute_address_2t(((y >> 3) & 2) | (x >> 4), x & 15, y & 15);
+	return p3x_make_attribute_address_2t(p3, ((y >> 3) & 2) | (x >> 4), x & 15, y & 15);
 }
 
-int p3_make_attribute_address_2t(int page, int x, int y)
+int p3x_make_attribute_address_2t(P3_OBJECT *p3, int page, int x, int y)
 {
 	page &= 3;
 	x &= 0x0f;
@@ -136,56 +143,56 @@ int p3_make_attribute_address_2t(int page, int x, int y)
 	return (page << 10) | 960 | ((y << 2) & 0x38) | (x >> 1);
 }
 
-int p3_get_attribute(int index)
+int p3x_get_attribute(P3_OBJECT *p3, int index)
 {
-	return p3_get_attribute_byte_item_x(p3_get_byte_at(p3_make_attribute_address(index)));
+	return p3x_get_attribute_byte_item_x(p3, p3x_get_byte_at(p3, p3x_make_attribute_address(p3, index)));
 }
 
-void p3_put_attribute(int index, int pal)
+void p3x_put_attribute(P3_OBJECT *p3, int index, int pal)
 {
-	int inc = p3_get_increment();
-	p3_set_increment(P3_INCREMENT_NONE);
-	p3_put_byte(p3_set_attribute_byte_item_x(p3_get_byte_at(p3_make_attribute_address(index)), pal));
-	p3_set_increment(inc);
+	int inc = p3x_get_increment(p3);
+	p3x_set_increment(p3, P3_INCREMENT_NONE);
+	p3x_put_byte(p3, p3x_set_attribute_byte_item_x(p3, p3x_get_byte_at(p3, p3x_make_attribute_address(p3, index)), pal));
+	p3x_set_increment(p3, inc);
 }
 
-int p3_get_attribute_1t(int page, int index)
+int p3x_get_attribute_1t(P3_OBJECT *p3, int page, int index)
 {
-	return p3_get_attribute_byte_item_x(p3_get_byte_at(p3_make_attribute_address_1t(page, index)));
+	return p3x_get_attribute_byte_item_x(p3, p3x_get_byte_at(p3, p3x_make_attribute_address_1t(p3, page, index)));
 }
 
-void p3_put_attribute_1t(int page, int index, int pal)
+void p3x_put_attribute_1t(P3_OBJECT *p3, int page, int index, int pal)
 {
-	int inc = p3_get_increment();
-	p3_set_increment(P3_INCREMENT_NONE);
-	p3_put_byte(p3_set_attribute_byte_item_x(p3_get_byte_at(p3_make_attribute_address_1t(page, index)), pal));
-	p3_set_increment(inc);
+	int inc = p3x_get_increment(p3);
+	p3x_set_increment(p3, P3_INCREMENT_NONE);
+	p3x_put_byte(p3, p3x_set_attribute_byte_item_x(p3, p3x_get_byte_at(p3, p3x_make_attribute_address_1t(p3, page, index)), pal));
+	p3x_set_increment(p3, inc);
 }
 
-int p3_get_attribute_2(int x, int y)
+int p3x_get_attribute_2(P3_OBJECT *p3, int x, int y)
 {
-	return p3_get_attribute_byte_item_x(p3_get_byte_at(p3_make_attribute_address_2(x, y)));
+	return p3x_get_attribute_byte_item_x(p3, p3x_get_byte_at(p3, p3x_make_attribute_address_2(p3, x, y)));
 }
 
-void p3_put_attribute_2(int x, int y, int pal)
+void p3x_put_attribute_2(P3_OBJECT *p3, int x, int y, int pal)
 {
-	int inc = p3_get_increment();
-	p3_set_increment(P3_INCREMENT_NONE);
-	p3_put_byte(p3_set_attribute_byte_item_x(p3_get_byte_at(p3_make_attribute_address_2(x, y)), pal));
-	p3_set_increment(inc);
+	int inc = p3x_get_increment(p3);
+	p3x_set_increment(p3, P3_INCREMENT_NONE);
+	p3x_put_byte(p3, p3x_set_attribute_byte_item_x(p3, p3x_get_byte_at(p3, p3x_make_attribute_address_2(p3, x, y)), pal));
+	p3x_set_increment(p3, inc);
 }
 
-int p3_get_attribute_2t(int page, int x, int y)
+int p3x_get_attribute_2t(P3_OBJECT *p3, int page, int x, int y)
 {
-	return p3_get_attribute_byte_item_x(p3_get_byte_at(p3_make_attribute_address_2t(page, x, y)));
+	return p3x_get_attribute_byte_item_x(p3, p3x_get_byte_at(p3, p3x_make_attribute_address_2t(p3, page, x, y)));
 }
 
-void p3_put_attribute_2t(int page, int x, int y, int pal)
+void p3x_put_attribute_2t(P3_OBJECT *p3, int page, int x, int y, int pal)
 {
-	int inc = p3_get_increment();
-	p3_set_increment(P3_INCREMENT_NONE);
-	p3_put_byte(p3_set_attribute_byte_item_x(p3_get_byte_at(p3_make_attribute_address_2t(page, x, y)), pal));
-	p3_set_increment(inc);
+	int inc = p3x_get_increment(p3);
+	p3x_set_increment(p3, P3_INCREMENT_NONE);
+	p3x_put_byte(p3, p3x_set_attribute_byte_item_x(p3, p3x_get_byte_at(p3, p3x_make_attribute_address_2t(p3, page, x, y)), pal));
+	p3x_set_increment(p3, inc);
 }
 
 int p3_make_flat_attribute_byte(int pal)
@@ -216,12 +223,12 @@ int p3_set_attribute_byte_item(int attr, int pos, int pal)
 	return (attr & attribute_reset_mask[pos]) | (pal << (pos << 1));
 }
 
-int p3_get_attribute_byte_item_x(int attr)
+int p3x_get_attribute_byte_item_x(P3_OBJECT *p3, int attr)
 {
 	return p3_get_attribute_byte_item(attr, S(last_attribute_pos));
 }
 
-int p3_set_attribute_byte_item_x(int attr, int pal)
+int p3x_set_attribute_byte_item_x(P3_OBJECT *p3, int attr, int pal)
 {
 	return p3_set_attribute_byte_item(attr, S(last_attribute_pos), pal);
 }
@@ -0,0 +1,240 @@
+/*
+ Copyright (C) 2019 Dmitry Korunos
+
+ This software is provided 'as-is', without any express or implied
+ warranty. In no event will the authors be held liable for any damages
+ arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it
+ freely, subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+ 2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+ 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "p3.h"
+#include "common.h"
+
+/* Internal interface of module */
+cadr_t g_page_chr_address(P3_OBJECT *p3, cadr_t address);
+void g_start_pager_frame(P3_OBJECT *p3);
+void g_release_pager(P3_OBJECT *obj);
+void g_copy_pager(P3_OBJECT *dst);
+
+/* mapper.c module */
+void g_update_mapper_fn(P3_OBJECT *p3);
+
+/* tile_cache.c module */
+void g_invalidate_tile_cache(P3_OBJECT *p3, int start, int num);
+
+/* Resident banks of tileset larger than memory given to it. Slot is 8 KB of
+   resident memory holding one bank, free slot holds bank -1 */
+struct bank_pager {
+	P3_BANK_LOADER loader;
+	void *param;
+	int bank_count;
+	int slot_count;
+	int *bank_slots;
+	int *slot_banks;
+	uint32_t *slot_stamps;
+	uint32_t stamp;
+	int faults;
+	int frame_faults;
+	byte *slots;
+};
+
+#define BANK_SIZE                           0x2000
+#define BANK_SHIFT                          13
+#define TILES_PER_BANK                      (BANK_SIZE >> 4)
+
+static void destroy_pager(struct bank_pager *pager)
+{
+	if (pager) {
+		free(pager->bank_slots);
+		free(pager->slot_banks);
+		free(pager->slot_stamps);
+		free(pager->slots);
+		free(pager);
+	}
+}
+
+/* Returns NULL if out of memory */
+static struct bank_pager *create_pager(int bank_count, int slot_count)
+{
+	struct bank_pager *pager = (struct bank_pager *) calloc(1, sizeof(struct bank_pager));
+	if (pager) {
+		pager->bank_count = bank_count;
+		pager->slot_count = slot_count;
+		pager->bank_slots = (int *) malloc(bank_count * sizeof(int));
+		pager->slot_banks = (int *) malloc(slot_count * sizeof(int));
+		pager->slot_stamps = (uint32_t *) calloc(slot_count, sizeof(uint32_t));
+		pager->slots = (byte *) calloc(slot_count, BANK_SIZE);
+		if (!pager->bank_slots || !pager->slot_banks || !pager->slot_stamps || !pager->slots) {
+			destroy_pager(pager);
+			return NULL;
+		}
+	}
+	return pager;
+}
+
+/* Banks of current windows can't be evicted */
+static BOOL is_bank_pinned(P3_OBJECT *p3, int bank)
+{
+	int i;
+	for (i = 0; i < 16; ++i) {
+		if ((int) (S(chr_banks)[i] >> BANK_SHIFT) == bank) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/* Free slot, or least recently used slot of bank not pinned by windows */
+static int find_victim_slot(P3_OBJECT *p3)
+{
+	struct bank_pager *pager = S(pager);
+	int victim = -1;
+	int i;
+
+	for (i = 0; i < pager->slot_count; ++i) {
+		if (pager->slot_banks[i] < 0) {
+			return i;
+		}
+		if (((victim < 0) || (pager->slot_stamps[i] < pager->slot_stamps[victim])) &&
+		    !is_bank_pinned(p3, pager->slot_banks[i])) {
+			victim = i;
+		}
+	}
+	return victim;
+}
+
+static int load_bank(P3_OBJECT *p3, int bank)
+{
+	struct bank_pager *pager = S(pager);
+	int slot = find_victim_slot(p3);
+	byte *dst = pager->slots + ((size_t) slot << BANK_SHIFT);
+
+	if (pager->slot_banks[slot] >= 0) {
+		pager->bank_slots[pager->slot_banks[slot]] = -1;
+	}
+	if (!pager->loader(dst, bank, pager->param)) {
+		memset(dst, 0, BANK_SIZE);
+		set_last_error("g_page_chr_address(): bank loader failed, bank is cleared");
+	}
+	pager->slot_banks[slot] = bank;
+	pager->bank_slots[bank] = slot;
+	++pager->faults;
+	/* Tiles of slot are decoded from new bank */
+	g_invalidate_tile_cache(p3, slot * TILES_PER_BANK, TILES_PER_BANK);
+	return slot;
+}
+
+/* Convert tileset address to offset in resident memory, loading its bank
+   on first use. Offset is valid until next bank of tileset is loaded */
+cadr_t g_page_chr_address(P3_OBJECT *p3, cadr_t address)
+{
+	struct bank_pager *pager = S(pager);
+	/* Bank out of tileset wraps around, like mirrored CHR-ROM */
+	int bank = (int) (address >> BANK_SHIFT) % pager->bank_count;
+	int slot = pager->bank_slots[bank];
+
+	if (slot < 0) {
+		slot = load_bank(p3, bank);
+	}
+	pager->slot_stamps[slot] = ++pager->stamp;
+	return ((cadr_t) slot << BANK_SHIFT) | (address & (BANK_SIZE - 1));
+}
+
+/* Faults counted since start of previous frame become faults of frame */
+void g_start_pager_frame(P3_OBJECT *p3)
+{
+	if (S(pager)) {
+		S(pager)->frame_faults = S(pager)->faults;
+		S(pager)->faults = 0;
+	}
+}
+
+void g_release_pager(P3_OBJECT *obj)
+{
+	destroy_pager(obj->pager);
+	obj->pager = NULL;
+}
+
+/* Object copy gets own resident banks, since they change by paging */
+void g_copy_pager(P3_OBJECT *dst)
+{
+	const struct bank_pager *src = dst->pager;
+
+	if (src) {
+		struct bank_pager *pager = create_pager(src->bank_count, src->slot_count);
+		if (pager) {
+			pager->loader = src->loader;
+			pager->param = src->param;
+			pager->stamp = src->stamp;
+			pager->faults = src->faults;
+			pager->frame_faults = src->frame_faults;
+			memcpy(pager->bank_slots, src->bank_slots, src->bank_count * sizeof(int));
+			memcpy(pager->slot_banks, src->slot_banks, src->slot_count * sizeof(int));
+			memcpy(pager->slot_stamps, src->slot_stamps, src->slot_count * sizeof(uint32_t));
+			memcpy(pager->slots, src->slots, (size_t) src->slot_count << BANK_SHIFT);
+			dst->tileset_pointer = pager->slots;
+		} else {
+			set_last_error("p3_copy_object(): out of memory, tileset not copied");
+			dst->tileset_pointer = NULL;
+		}
+		dst->pager = pager;
+	}
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Tileset of 'chr_size' bytes is loaded by banks of 8 KB when mapper selects
+   them, at most 'resident_banks' banks are kept in memory */
+P3_OBJECT *p3_create_object_paged(int chr_size, int resident_banks, P3_BANK_LOADER loader, void *param)
+{
+	P3_OBJECT *obj = NULL;
+
+	if (!loader) {
+		set_last_error("p3_create_object_paged(): bad 'loader' argument");
+	} else if ((chr_size <= 0) || (chr_size & (BANK_SIZE - 1))) {
+		set_last_error("p3_create_object_paged(): bad 'chr_size' argument");
+	} else if (resident_banks < P3_MIN_RESIDENT_BANKS) {
+		set_last_error("p3_create_object_paged(): bad 'resident_banks' argument");
+	} else {
+		int bank_count = chr_size >> BANK_SHIFT;
+		struct bank_pager *pager = create_pager(bank_count,
+		                                        resident_banks < bank_count ? resident_banks : bank_count);
+		if (pager) {
+			int i;
+			pager->loader = loader;
+			pager->param = param;
+			for (i = 0; i < bank_count; ++i) {
+				pager->bank_slots[i] = -1;
+			}
+			for (i = 0; i < pager->slot_count; ++i) {
+				pager->slot_banks[i] = -1;
+			}
+			/* Windows map into first resident slot until pager is attached */
+			obj = p3_create_object(pager->slots, chr_size);
+			if (obj) {
+				obj->pager = pager;
+				obj->tileset_storage = pager->slot_count << BANK_SHIFT;
+				g_update_mapper_fn(obj);
+				pager->faults = 0;
+			} else {
+				destroy_pager(pager);
+			}
+		} else {
+			set_last_error("p3_create_object_paged(): out of memory");
+		}
+	}
+	return obj;
+}
+
+int p3x_get_bank_faults(P3_OBJECT *p3) { return S(pager) ? S(pager)->frame_faults : 0; }
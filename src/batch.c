@@ -0,0 +1,317 @@
+/*
+ Copyright (C) 2019 Dmitry Korunos
+
+ This software is provided 'as-is', without any express or implied
+ warranty. In no event will the authors be held liable for any damages
+ arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it
+ freely, subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+ 2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+ 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "p3.h"
+#include "common.h"
+
+USE_P3_OBJECT;
+
+/* Internal interface of module */
+BOOL g_run_render_pool(void (*job)(void *, long), void *context, long num);
+
+/* thread.c module */
+struct p3_thread *g_start_thread(void (*proc)(void *), void *param);
+void g_join_thread(struct p3_thread *thread);
+void g_set_thread_affinity(struct p3_thread *thread, int cpu);
+int g_get_cpu_count(void);
+struct p3_semaphore *g_create_semaphore(void);
+void g_destroy_semaphore(struct p3_semaphore *sem);
+void g_post_semaphore(struct p3_semaphore *sem, int count);
+void g_wait_semaphore(struct p3_semaphore *sem);
+long g_atomic_increment(volatile long *value);
+void g_lock_process(void);
+void g_unlock_process(void);
+
+/* Jobs of run are split in ranges, one per thread. Thread takes jobs from
+   own range, then steals from ranges of other threads */
+struct batch_range {
+	volatile long next;
+	long end;
+	/* keep ranges in separate cache lines */
+	char padding[64 - 2 * sizeof(long)];
+};
+
+struct render_worker {
+	struct render_pool *pool;
+	struct p3_thread *thread;
+	int index;
+};
+
+/* Worker threads sleep between runs, calling thread of run works too */
+struct render_pool {
+	int nworkers;
+	struct render_worker *workers;
+	struct batch_range *ranges;
+	struct p3_semaphore *start;
+	struct p3_semaphore *done;
+	BOOL quit;
+	/* current run */
+	void (*job)(void *, long);
+	void *context;
+};
+
+/* Pool is used by one run at a time. Owner of pool may start, stop or run
+   it without lock, pointer is changed under process lock for readers */
+static struct render_pool *render_pool = NULL;
+static BOOL render_pool_busy = FALSE;
+
+/* Returns FALSE if pool is owned by other run or by caller itself */
+static BOOL claim_render_pool(void)
+{
+	BOOL claimed = FALSE;
+
+	g_lock_process();
+	if (!render_pool_busy) {
+		render_pool_busy = TRUE;
+		claimed = TRUE;
+	}
+	g_unlock_process();
+	return claimed;
+}
+
+static void release_render_pool(void)
+{
+	g_lock_process();
+	render_pool_busy = FALSE;
+	g_unlock_process();
+}
+
+static void publish_render_pool(struct render_pool *pool)
+{
+	g_lock_process();
+	render_pool = pool;
+	g_unlock_process();
+}
+
+/* Run jobs until all ranges are empty */
+static void run_jobs(struct render_pool *pool, int self)
+{
+	int nranges = pool->nworkers + 1;
+	int i;
+
+	for (i = 0; i < nranges; ++i) {
+		struct batch_range *range = &pool->ranges[(self + i) % nranges];
+		long index;
+		while ((index = g_atomic_increment(&range->next) - 1) < range->end) {
+			pool->job(pool->context, index);
+		}
+	}
+}
+
+static void worker_proc(void *param)
+{
+	struct render_worker *worker = (struct render_worker *) param;
+	struct render_pool *pool = worker->pool;
+
+	for (;;) {
+		g_wait_semaphore(pool->start);
+		if (pool->quit) {
+			break;
+		}
+		run_jobs(pool, worker->index);
+		g_post_semaphore(pool->done, 1);
+	}
+}
+
+static void free_render_pool(struct render_pool *pool)
+{
+	free(pool->workers);
+	free(pool->ranges);
+	g_destroy_semaphore(pool->start);
+	g_destroy_semaphore(pool->done);
+	free(pool);
+}
+
+/* Caller must own pool */
+static void stop_render_pool(void)
+{
+	struct render_pool *pool = render_pool;
+	int i;
+
+	if (pool) {
+		publish_render_pool(NULL);
+		pool->quit = TRUE;
+		g_post_semaphore(pool->start, pool->nworkers);
+		for (i = 0; i < pool->nworkers; ++i) {
+			g_join_thread(pool->workers[i].thread);
+		}
+		free_render_pool(pool);
+	}
+}
+
+/* Caller must own pool. Pool keeps threads that could be started, returns
+   FALSE if none */
+static BOOL start_render_pool(int nthreads, const int *cpus)
+{
+	struct render_pool *pool = (struct render_pool *) calloc(1, sizeof(struct render_pool));
+	int i;
+
+	if (!pool) {
+		return FALSE;
+	}
+	pool->workers = (struct render_worker *) calloc(nthreads, sizeof(struct render_worker));
+	pool->ranges = (struct batch_range *) calloc(nthreads + 1, sizeof(struct batch_range));
+	pool->start = g_create_semaphore();
+	pool->done = g_create_semaphore();
+	if (!pool->workers || !pool->ranges || !pool->start || !pool->done) {
+		free_render_pool(pool);
+		return FALSE;
+	}
+	for (i = 0; i < nthreads; ++i) {
+		struct render_worker *worker = &pool->workers[pool->nworkers];
+		worker->pool = pool;
+		/* Range 0 belongs to calling thread */
+		worker->index = pool->nworkers + 1;
+		worker->thread = g_start_thread(worker_proc, worker);
+		if (worker->thread) {
+			if (cpus) {
+				g_set_thread_affinity(worker->thread, cpus[i]);
+			}
+			++pool->nworkers;
+		}
+	}
+	if (!pool->nworkers) {
+		free_render_pool(pool);
+		return FALSE;
+	}
+	publish_render_pool(pool);
+	return TRUE;
+}
+
+/* Run job for indexes 0..num-1 on pool threads and calling thread. Pool with
+   thread per additional CPU is started if p3_set_render_pool() isn't called
+   before. Returns FALSE without running jobs if there is no pool or pool is
+   busy with other run, caller runs jobs itself then */
+BOOL g_run_render_pool(void (*job)(void *, long), void *context, long num)
+{
+	struct render_pool *pool;
+	int nranges, i;
+
+	if (!claim_render_pool()) {
+		return FALSE;
+	}
+	if (!render_pool && (g_get_cpu_count() > 1)) {
+		start_render_pool(g_get_cpu_count() - 1, NULL);
+	}
+	pool = render_pool;
+	if (!pool) {
+		release_render_pool();
+		return FALSE;
+	}
+	nranges = pool->nworkers + 1;
+	for (i = 0; i < nranges; ++i) {
+		pool->ranges[i].next = num * i / nranges;
+		pool->ranges[i].end = num * (i + 1) / nranges;
+	}
+	pool->job = job;
+	pool->context = context;
+	g_post_semaphore(pool->start, pool->nworkers);
+	run_jobs(pool, 0);
+	for (i = 0; i < pool->nworkers; ++i) {
+		g_wait_semaphore(pool->done);
+	}
+	release_render_pool();
+	return TRUE;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+struct render_batch {
+	P3_OBJECT **objects;
+	P3_BATCH_CALLBACK proc;
+	void *param;
+};
+
+static void render_batch_object(void *context, long index)
+{
+	struct render_batch *batch = (struct render_batch *) context;
+	P3_OBJECT *obj = batch->objects[index];
+	/* Callbacks of object use current object API */
+	P3_OBJECT *prev_obj = g_thread_p3obj;
+
+	g_thread_p3obj = obj;
+	p3x_render(obj);
+	if (batch->proc) {
+		batch->proc(obj, (int) index, batch->param);
+	}
+	g_thread_p3obj = prev_obj;
+}
+
+/* Threads are started in addition to calling thread of p3_render_batch(),
+   'cpus' is NULL or array of 'nthreads' CPU numbers, negative for no hint.
+   Zero threads stops pool. Fails while pool renders, including calls from
+   callbacks of batch */
+void p3_set_render_pool(int nthreads, const int *cpus)
+{
+	if (nthreads >= 0) {
+		if (!claim_render_pool()) {
+			set_last_error("p3_set_render_pool(): pool is busy");
+			return;
+		}
+		stop_render_pool();
+		if (nthreads > 0) {
+			if (!start_render_pool(nthreads, cpus)) {
+				set_last_error("p3_set_render_pool(): can't start threads");
+			}
+		}
+		release_render_pool();
+	} else {
+		set_last_error("p3_set_render_pool(): bad 'nthreads' argument");
+	}
+}
+
+int p3_get_render_pool_size(void)
+{
+	int size;
+
+	g_lock_process();
+	size = render_pool ? render_pool->nworkers : 0;
+	g_unlock_process();
+	return size;
+}
+
+/* Objects must be distinct. Callback is called on rendering thread right
+   after frame of object is rendered. Batches may be rendered by several
+   threads at once, but one batch at a time uses pool, others (and batches
+   from callbacks) are rendered serially on calling thread */
+void p3_render_batch(P3_OBJECT **objects, int num, P3_BATCH_CALLBACK proc, void *param)
+{
+	struct render_batch batch;
+	int i;
+
+	if (objects && (num >= 0)) {
+		for (i = 0; i < num; ++i) {
+			if (!objects[i]) {
+				set_last_error("p3_render_batch(): bad 'objects' argument");
+				return;
+			}
+		}
+		batch.objects = objects;
+		batch.proc = proc;
+		batch.param = param;
+		if ((num < 2) || !g_run_render_pool(render_batch_object, &batch, num)) {
+			for (i = 0; i < num; ++i) {
+				render_batch_object(&batch, i);
+			}
+		}
+	} else {
+		set_last_error("p3_render_batch(): bad arguments");
+	}
+}
@@ -0,0 +1,187 @@
+/*
+ Copyright (C) 2019 Dmitry Korunos
+
+ This software is provided 'as-is', without any express or implied
+ warranty. In no event will the authors be held liable for any damages
+ arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it
+ freely, subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+ 2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+ 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "p3.h"
+#include "common.h"
+
+/* Internal interface of module */
+BOOL g_prepare_bg_plane(P3_OBJECT *p3);
+void g_fill_bg_plane(P3_OBJECT *obj);
+void g_read_bg_plane_line(P3_OBJECT *obj, byte *dst, int cell_x, int y);
+void g_invalidate_bg_plane(P3_OBJECT *obj);
+void g_invalidate_bg_plane_byte(P3_OBJECT *obj, padr_t address);
+void g_release_bg_plane(P3_OBJECT *obj);
+
+/* mapper.c module */
+cadr_t g_map_tile_address(P3_OBJECT *p3, padr_t);
+
+/* tile_cache.c module */
+void g_decode_tile_row(byte *dst, byte lo, byte hi, BOOL flip);
+
+/* Plane holds background color indexes of four pages, page 1 is right of
+   page 0, pages 2 and 3 are below them. Cell is 8x8 pixels of one tile */
+#define PLANE_WIDTH                         512
+#define PLANE_HEIGHT                        480
+#define PLANE_CELLS_X                       64
+#define PLANE_CELLS_Y                       60
+#define PLANE_CELL_COUNT                    (PLANE_CELLS_X * PLANE_CELLS_Y)
+
+static void decode_cell(P3_OBJECT *obj, int cell_x, int cell_y)
+{
+	int page = ((cell_y >= 30) << 1) | (cell_x >> 5);
+	int cx = cell_x & 31;
+	int cy = cell_y >= 30 ? cell_y - 30 : cell_y;
+	padr_t base = obj->page_bases[page];
+	byte name = obj->page_memory[base | (cy << 5) | cx];
+	byte attributes = obj->page_memory[base | 960 | ((cx >> 2) | (cy & 0x1c) << 1)];
+	byte *dst = obj->bg_plane + cell_y * 8 * PLANE_WIDTH + cell_x * 8;
+	byte ext = 0;
+	int row, i;
+
+	if (obj->ext_attributes_enabled) {
+		ext = obj->ext_memory[base | (cy << 5) | cx];
+		attributes = (ext >> 6) << 2;
+	} else {
+		attributes = ((attributes >> ((cx & 2) | ((cy & 2) << 1))) & 3) << 2;
+	}
+	for (row = 0; row < 8; ++row, dst += PLANE_WIDTH) {
+		cadr_t address = obj->ext_attributes_enabled ?
+			obj->ext_banks[ext & 0x3f] | (name << 4) | row :
+			g_map_tile_address(obj, obj->bg_plane_chr_base | (name << 4) | row);
+		g_decode_tile_row(dst, obj->tileset_pointer[address], obj->tileset_pointer[address + 8], FALSE);
+		for (i = 0; i < 8; ++i) {
+			dst[i] |= attributes;
+		}
+	}
+	obj->bg_plane_valid[cell_y * PLANE_CELLS_X + cell_x] = TRUE;
+}
+
+/* Allocate plane if enabled, plane memory isn't shared by object copies */
+BOOL g_prepare_bg_plane(P3_OBJECT *p3)
+{
+	if (S(bg_plane_enabled) && !S(bg_plane)) {
+		S(bg_plane) = (byte*) malloc(PLANE_WIDTH * PLANE_HEIGHT);
+		S(bg_plane_valid) = (byte*) calloc(PLANE_CELL_COUNT, 1);
+		S(bg_plane_chr_base) = S(bg_chr_base);
+		if (!S(bg_plane) || !S(bg_plane_valid)) {
+			g_release_bg_plane(p3);
+			S(bg_plane_enabled) = FALSE;
+			set_last_error("p3_enable_bg_plane(): out of memory");
+			return FALSE;
+		}
+	}
+	return S(bg_plane) != NULL;
+}
+
+/* Decode all invalid cells, then plane is read only for render threads */
+void g_fill_bg_plane(P3_OBJECT *obj)
+{
+	const byte *valid = obj->bg_plane_valid;
+	const byte *invalid = (const byte*) memchr(valid, FALSE, PLANE_CELL_COUNT);
+	while (invalid) {
+		int cell = (int) (invalid - valid);
+		decode_cell(obj, cell % PLANE_CELLS_X, cell / PLANE_CELLS_X);
+		invalid = (const byte*) memchr(invalid + 1, FALSE, PLANE_CELL_COUNT - cell - 1);
+	}
+}
+
+/* Copy 33 tile spans of plane row y, starting at cell column cell_x */
+void g_read_bg_plane_line(P3_OBJECT *obj, byte *dst, int cell_x, int y)
+{
+	const byte *valid = obj->bg_plane_valid + (y >> 3) * PLANE_CELLS_X;
+	const byte *src = obj->bg_plane + y * PLANE_WIDTH;
+	int head = PLANE_CELLS_X - cell_x;
+	int t;
+
+	for (t = 0; t < 33; ++t) {
+		int cell = (cell_x + t) & (PLANE_CELLS_X - 1);
+		if (!valid[cell]) {
+			decode_cell(obj, cell, y >> 3);
+		}
+	}
+	/* Row wraps around right border of plane */
+	if (head >= 33) {
+		memcpy(dst, src + cell_x * 8, 33 * 8);
+	} else {
+		memcpy(dst, src + cell_x * 8, head * 8);
+		memcpy(dst + head * 8, src, (33 - head) * 8);
+	}
+}
+
+void g_invalidate_bg_plane(P3_OBJECT *obj)
+{
+	if (obj->bg_plane_valid) {
+		memset(obj->bg_plane_valid, FALSE, PLANE_CELL_COUNT);
+	}
+	obj->bg_plane_chr_base = obj->bg_chr_base;
+}
+
+/* Invalidate cells of all pages mirrored to nametable byte */
+void g_invalidate_bg_plane_byte(P3_OBJECT *obj, padr_t address)
+{
+	int offset = address & 1023;
+	int page;
+
+	if (!obj->bg_plane_valid) {
+		return;
+	}
+	for (page = 0; page < 4; ++page) {
+		if ((obj->page_bases[page] >> 10) == (address >> 10)) {
+			byte *valid = obj->bg_plane_valid + (page >> 1) * 30 * PLANE_CELLS_X + (page & 1) * 32;
+			if (offset < 960) {
+				valid[(offset >> 5) * PLANE_CELLS_X + (offset & 31)] = FALSE;
+			} else {
+				/* Attribute byte covers 4x4 tiles */
+				int ax = ((offset - 960) & 7) * 4;
+				int ay = ((offset - 960) >> 3) * 4;
+				int y;
+				for (y = ay; (y < ay + 4) && (y < 30); ++y) {
+					memset(valid + y * PLANE_CELLS_X + ax, FALSE, 4);
+				}
+			}
+		}
+	}
+}
+
+void g_release_bg_plane(P3_OBJECT *obj)
+{
+	free(obj->bg_plane);
+	free(obj->bg_plane_valid);
+	obj->bg_plane = NULL;
+	obj->bg_plane_valid = NULL;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+int p3x_is_bg_plane_enabled(P3_OBJECT *p3) { return S(bg_plane_enabled); }
+
+/* Renderer without callbacks copies background lines from plane of
+   pre-rendered pages, plane is updated by cells changed since last frame */
+void p3x_enable_bg_plane(P3_OBJECT *p3, int flag)
+{
+	if (S(idle)) {
+		S(bg_plane_enabled) = TO_BOOL(flag);
+		if (S(bg_plane_enabled)) {
+			g_prepare_bg_plane(p3);
+		} else {
+			g_release_bg_plane(p3);
+		}
+	}
+}
@@ -0,0 +1,318 @@
+/*
+ Copyright (C) 2019 Dmitry Korunos
+
+ This software is provided 'as-is', without any express or implied
+ warranty. In no event will the authors be held liable for any damages
+ arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it
+ freely, subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+ 2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+ 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#if defined(_WIN32)
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+#include "p3.h"
+#include "common.h"
+
+/* Internal interface of module */
+void g_release_chr_file(P3_OBJECT *obj);
+void g_copy_chr_file(P3_OBJECT *dst);
+
+/* chr_pack.c module */
+int g_get_pack_bank_count(const byte *pack, size_t size);
+BOOL g_unpack_chr_bank(const byte *pack, size_t size, int bank, byte *dst);
+
+/* tileset.c module */
+BOOL g_is_valid_chr_size(size_t size);
+
+/* thread.c module */
+void g_lock_process(void);
+void g_unlock_process(void);
+
+/* Read-only view of file, shared by all objects created from same path.
+   View of CHR pack has no 'chr', its banks are unpacked by pagers */
+struct chr_file {
+	struct chr_file *next;
+	char *path;
+	BOOL packed;
+	int refs;
+	void *view;
+	size_t view_size;
+	byte *chr;
+	int chr_size;
+};
+
+/* Files mapped by process, guarded by g_lock_process() */
+static struct chr_file *chr_files = NULL;
+
+#define INES_HEADER_SIZE                    16
+#define INES_TRAINER_SIZE                   512
+#define INES_PRG_UNIT                       0x4000
+#define INES_CHR_UNIT                       0x2000
+
+/* NES 2.0 ROM size, 'msb' 0x0F selects exponent-multiplier notation */
+static size_t get_rom_size(byte lsb, byte msb, size_t unit)
+{
+	if (msb == 0x0F) {
+		return ((size_t) 1 << (lsb >> 2)) * ((lsb & 3) * 2 + 1);
+	}
+	return (((size_t) msb << 8) | lsb) * unit;
+}
+
+/* Find CHR-ROM of iNES or NES 2.0 image, file without header is raw CHR */
+static BOOL locate_chr(const byte *data, size_t size, size_t *offset, size_t *chr_size)
+{
+	size_t prg_size;
+
+	if ((size < INES_HEADER_SIZE) || memcmp(data, "NES\x1a", 4)) {
+		*offset = 0;
+		*chr_size = size;
+		return TRUE;
+	}
+	if ((data[7] & 0x0C) == 0x08) {
+		prg_size = get_rom_size(data[4], data[9] & 0x0F, INES_PRG_UNIT);
+		*chr_size = get_rom_size(data[5], data[9] >> 4, INES_CHR_UNIT);
+	} else {
+		prg_size = data[4] * (size_t) INES_PRG_UNIT;
+		*chr_size = data[5] * (size_t) INES_CHR_UNIT;
+	}
+	*offset = INES_HEADER_SIZE + ((data[6] & 4) ? INES_TRAINER_SIZE : 0) + prg_size;
+	return (*chr_size != 0) && (*offset <= size) && (*chr_size <= size - *offset);
+}
+
+static void *map_file(const char *path, size_t *size)
+{
+	void *view = NULL;
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+	                          FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file != INVALID_HANDLE_VALUE) {
+		DWORD high = 0;
+		DWORD low = GetFileSize(file, &high);
+		if ((low != INVALID_FILE_SIZE) && !high && low) {
+			HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping) {
+				view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				*size = low;
+				/* View keeps mapping open */
+				CloseHandle(mapping);
+			}
+		}
+		CloseHandle(file);
+	}
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd >= 0) {
+		struct stat st;
+		if (!fstat(fd, &st) && (st.st_size > 0)) {
+			view = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			if (view == MAP_FAILED) {
+				view = NULL;
+			}
+			*size = (size_t) st.st_size;
+		}
+		/* Mapping stays valid after file is closed */
+		close(fd);
+	}
+#endif
+	return view;
+}
+
+static void unmap_file(void *view, size_t size)
+{
+#if defined(_WIN32)
+	UnmapViewOfFile(view);
+#else
+	munmap(view, size);
+#endif
+}
+
+/* Returns error or NULL if file is raw CHR or iNES image with CHR-ROM */
+static const char *parse_chr_file(struct chr_file *file)
+{
+	size_t offset, chr_size;
+
+	if (!locate_chr((const byte *) file->view, file->view_size, &offset, &chr_size)) {
+		return "p3_create_object_from_file(): bad iNES image or no CHR-ROM";
+	}
+	if (!g_is_valid_chr_size(chr_size)) {
+		return "p3_create_object_from_file(): unsupported CHR size";
+	}
+	file->chr = (byte *) file->view + offset;
+	file->chr_size = (int) chr_size;
+	return NULL;
+}
+
+/* Returns error or NULL if file is CHR pack */
+static const char *parse_pack_file(struct chr_file *file)
+{
+	int count = g_get_pack_bank_count((const byte *) file->view, file->view_size);
+
+	if (!count) {
+		return "p3_create_object_from_pack(): bad CHR pack";
+	}
+	file->chr_size = count * P3_CHR_SIZE_8;
+	return NULL;
+}
+
+/* Map file or take reference to file mapped before, call under lock */
+static struct chr_file *open_chr_file(const char *path, BOOL packed)
+{
+	struct chr_file *file;
+	const char *err;
+
+	for (file = chr_files; file; file = file->next) {
+		if (!strcmp(file->path, path) && (file->packed == packed)) {
+			++file->refs;
+			return file;
+		}
+	}
+	file = (struct chr_file *) calloc(1, sizeof(struct chr_file));
+	if (!file) {
+		set_last_error(packed ? "p3_create_object_from_pack(): out of memory" :
+		               "p3_create_object_from_file(): out of memory");
+		return NULL;
+	}
+	file->path = (char *) malloc(strlen(path) + 1);
+	file->view = map_file(path, &file->view_size);
+	if (!file->path || !file->view) {
+		if (!file->path) {
+			err = packed ? "p3_create_object_from_pack(): out of memory" :
+			               "p3_create_object_from_file(): out of memory";
+		} else {
+			err = packed ? "p3_create_object_from_pack(): can't map file" :
+			               "p3_create_object_from_file(): can't map file";
+		}
+	} else {
+		err = packed ? parse_pack_file(file) : parse_chr_file(file);
+	}
+	if (!err) {
+		strcpy(file->path, path);
+		file->packed = packed;
+		file->refs = 1;
+		file->next = chr_files;
+		chr_files = file;
+		return file;
+	}
+	set_last_error(err);
+	if (file->view) {
+		unmap_file(file->view, file->view_size);
+	}
+	free(file->path);
+	free(file);
+	return NULL;
+}
+
+/* Unmap file when last object using it is destroyed, call under lock */
+static void close_chr_file(struct chr_file *file)
+{
+	if (!--file->refs) {
+		struct chr_file **link = &chr_files;
+		while (*link != file) {
+			link = &(*link)->next;
+		}
+		*link = file->next;
+		unmap_file(file->view, file->view_size);
+		free(file->path);
+		free(file);
+	}
+}
+
+void g_release_chr_file(P3_OBJECT *obj)
+{
+	if (obj->chr_file) {
+		g_lock_process();
+		close_chr_file(obj->chr_file);
+		g_unlock_process();
+		obj->chr_file = NULL;
+	}
+}
+
+/* Object copy takes own reference to file of source object */
+void g_copy_chr_file(P3_OBJECT *dst)
+{
+	if (dst->chr_file) {
+		g_lock_process();
+		++dst->chr_file->refs;
+		g_unlock_process();
+	}
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Tileset is read-only view of CHR file or of CHR-ROM of iNES image, all
+   objects created from same path share one mapping */
+P3_OBJECT *p3_create_object_from_file(const char *path)
+{
+	P3_OBJECT *obj = NULL;
+
+	if (path) {
+		struct chr_file *file;
+		g_lock_process();
+		file = open_chr_file(path, FALSE);
+		g_unlock_process();
+		if (file) {
+			obj = p3_create_object(file->chr, file->chr_size);
+			if (obj) {
+				obj->chr_file = file;
+			} else {
+				g_lock_process();
+				close_chr_file(file);
+				g_unlock_process();
+			}
+		}
+	} else {
+		set_last_error("p3_create_object_from_file(): bad 'path' argument");
+	}
+	return obj;
+}
+
+/* Bank loader of paged tileset, 'param' is mapped pack */
+static int load_pack_bank(void *dst, int bank8k, void *param)
+{
+	const struct chr_file *file = (const struct chr_file *) param;
+	return g_unpack_chr_bank((const byte *) file->view, file->view_size, bank8k, (byte *) dst);
+}
+
+/* Tileset is paged from CHR pack made by p3_pack_chr(), banks are unpacked
+   when mapper selects them. Objects created from same path share mapping
+   of pack, but each object has own resident banks */
+P3_OBJECT *p3_create_object_from_pack(const char *path, int resident_banks)
+{
+	P3_OBJECT *obj = NULL;
+
+	if (path) {
+		struct chr_file *file;
+		g_lock_process();
+		file = open_chr_file(path, TRUE);
+		g_unlock_process();
+		if (file) {
+			obj = p3_create_object_paged(file->chr_size, resident_banks, load_pack_bank, file);
+			if (obj) {
+				obj->chr_file = file;
+			} else {
+				g_lock_process();
+				close_chr_file(file);
+				g_unlock_process();
+			}
+		}
+	} else {
+		set_last_error("p3_create_object_from_pack(): bad 'path' argument");
+	}
+	return obj;
+}
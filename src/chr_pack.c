@@ -0,0 +1,238 @@
+/*
+ Copyright (C) 2019 Dmitry Korunos
+
+ This software is provided 'as-is', without any express or implied
+ warranty. In no event will the authors be held liable for any damages
+ arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it
+ freely, subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+ 2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+ 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "p3.h"
+#include "common.h"
+
+/* Internal interface of module */
+int g_get_pack_bank_count(const byte *pack, size_t size);
+BOOL g_unpack_chr_bank(const byte *pack, size_t size, int bank, byte *dst);
+
+/* CHR pack: magic, number of 8 KB banks and offsets of bank blocks from
+   start of pack, one more offset ends last block. All numbers are 32-bit
+   little-endian. Block of 8 KB is stored bank, shorter block is LZSS
+   stream: flag byte for 8 items, bit 1 is literal byte, bit 0 is match of
+   2 bytes, 12-bit distance - 1 and 4-bit length - 3 */
+#define PACK_MAGIC                          "P3CP"
+#define PACK_HEADER_SIZE                    8
+#define BANK_SIZE                           0x2000
+#define MIN_MATCH                           3
+#define MAX_MATCH                           18
+#define MAX_DISTANCE                        4096
+#define HASH_SIZE                           4096
+#define MAX_CHAIN                           64
+
+static uint32_t read_u32(const byte *src)
+{
+	return src[0] | ((uint32_t) src[1] << 8) | ((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+static void write_u32(byte *dst, uint32_t value)
+{
+	dst[0] = (byte) value;
+	dst[1] = (byte) (value >> 8);
+	dst[2] = (byte) (value >> 16);
+	dst[3] = (byte) (value >> 24);
+}
+
+/* Only header and index are checked, blocks are checked when unpacked.
+   Returns 0 if data isn't CHR pack */
+int g_get_pack_bank_count(const byte *pack, size_t size)
+{
+	uint32_t count, i;
+
+	if ((size < PACK_HEADER_SIZE) || memcmp(pack, PACK_MAGIC, 4)) {
+		return 0;
+	}
+	count = read_u32(pack + 4);
+	if (!count || (count > (P3_CHR_SIZE_MAX / BANK_SIZE)) ||
+	    ((size - PACK_HEADER_SIZE) / 4 <= count)) {
+		return 0;
+	}
+	for (i = 0; i <= count; ++i) {
+		uint32_t offset = read_u32(pack + PACK_HEADER_SIZE + i * 4);
+		if ((offset > size) || (i && (offset < read_u32(pack + PACK_HEADER_SIZE + i * 4 - 4)))) {
+			return 0;
+		}
+	}
+	return (int) count;
+}
+
+static BOOL unpack_block(const byte *src, size_t size, byte *dst)
+{
+	size_t pos = 0;
+	int out = 0;
+
+	while (out < BANK_SIZE) {
+		int flags, bit;
+		if (pos >= size) {
+			return FALSE;
+		}
+		flags = src[pos++];
+		for (bit = 0; (bit < 8) && (out < BANK_SIZE); ++bit, flags >>= 1) {
+			if (flags & 1) {
+				if (pos >= size) {
+					return FALSE;
+				}
+				dst[out++] = src[pos++];
+			} else {
+				int distance, length;
+				if (pos + 2 > size) {
+					return FALSE;
+				}
+				distance = (src[pos] | ((src[pos + 1] & 0xF0) << 4)) + 1;
+				length = (src[pos + 1] & 0x0F) + MIN_MATCH;
+				pos += 2;
+				if ((distance > out) || (length > BANK_SIZE - out)) {
+					return FALSE;
+				}
+				/* Match may overlap its own output */
+				for (; length; --length, ++out) {
+					dst[out] = dst[out - distance];
+				}
+			}
+		}
+	}
+	return TRUE;
+}
+
+/* Unpack 8 KB bank of pack checked by g_get_pack_bank_count(), returns
+   FALSE if bank is out of range or block is damaged */
+BOOL g_unpack_chr_bank(const byte *pack, size_t size, int bank, byte *dst)
+{
+	uint32_t start, end;
+
+	if ((bank < 0) || ((uint32_t) bank >= read_u32(pack + 4))) {
+		return FALSE;
+	}
+	start = read_u32(pack + PACK_HEADER_SIZE + bank * 4);
+	end = read_u32(pack + PACK_HEADER_SIZE + bank * 4 + 4);
+	if ((start > end) || (end > size)) {
+		return FALSE;
+	}
+	if (end - start == BANK_SIZE) {
+		memcpy(dst, pack + start, BANK_SIZE);
+		return TRUE;
+	}
+	return unpack_block(pack + start, end - start, dst);
+}
+
+static int hash3(const byte *src)
+{
+	return ((src[0] << 4) ^ (src[1] << 2) ^ src[2]) & (HASH_SIZE - 1);
+}
+
+/* Greedy LZSS of one bank, returns 0 if block doesn't fit to 'dst_size' */
+static int pack_block(const byte *src, byte *dst, int dst_size)
+{
+	int head[HASH_SIZE];
+	int prev[BANK_SIZE];
+	int pos = 0, out = 0, flags_pos = 0, bit = 8;
+
+	memset(head, -1, sizeof(head));
+	while (pos < BANK_SIZE) {
+		int best_length = 0, best_distance = 0;
+		int length;
+		if (bit == 8) {
+			if (out >= dst_size) {
+				return 0;
+			}
+			flags_pos = out++;
+			dst[flags_pos] = 0;
+			bit = 0;
+		}
+		if (pos + MIN_MATCH <= BANK_SIZE) {
+			int candidate = head[hash3(src + pos)];
+			int chain = MAX_CHAIN;
+			while ((candidate >= 0) && (pos - candidate <= MAX_DISTANCE) && chain--) {
+				int max = BANK_SIZE - pos < MAX_MATCH ? BANK_SIZE - pos : MAX_MATCH;
+				for (length = 0; (length < max) && (src[candidate + length] == src[pos + length]); ++length);
+				if (length > best_length) {
+					best_length = length;
+					best_distance = pos - candidate;
+				}
+				candidate = prev[candidate];
+			}
+		}
+		if (best_length >= MIN_MATCH) {
+			if (out + 2 > dst_size) {
+				return 0;
+			}
+			dst[out++] = (byte) (best_distance - 1);
+			dst[out++] = (byte) ((((best_distance - 1) >> 4) & 0xF0) | (best_length - MIN_MATCH));
+		} else {
+			if (out >= dst_size) {
+				return 0;
+			}
+			dst[flags_pos] |= 1 << bit;
+			dst[out++] = src[pos];
+			best_length = 1;
+		}
+		++bit;
+		/* Add all passed positions to hash chains */
+		for (length = 0; length < best_length; ++length, ++pos) {
+			if (pos + MIN_MATCH <= BANK_SIZE) {
+				int hash = hash3(src + pos);
+				prev[pos] = head[hash];
+				head[hash] = pos;
+			}
+		}
+	}
+	return out;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Make CHR pack of tileset, P3_PACK_BOUND(chr_size) bytes of 'dst' are
+   always enough. Returns size of pack or 0 if it doesn't fit */
+int p3_pack_chr(void *dst, int dst_size, const void *chr, int chr_size)
+{
+	if (dst && chr && (chr_size > 0) && !(chr_size & (BANK_SIZE - 1))) {
+		byte *pack = (byte *) dst;
+		const byte *src = (const byte *) chr;
+		int count = chr_size / BANK_SIZE;
+		int out = PACK_HEADER_SIZE + (count + 1) * 4;
+		int bank;
+
+		if (out > dst_size) {
+			return 0;
+		}
+		memcpy(pack, PACK_MAGIC, 4);
+		write_u32(pack + 4, count);
+		for (bank = 0; bank < count; ++bank, src += BANK_SIZE) {
+			/* Block of 8 KB and more is stored */
+			int length = pack_block(src, pack + out, dst_size - out < BANK_SIZE - 1 ?
+			                        dst_size - out : BANK_SIZE - 1);
+			if (!length) {
+				if (dst_size - out < BANK_SIZE) {
+					return 0;
+				}
+				memcpy(pack + out, src, BANK_SIZE);
+				length = BANK_SIZE;
+			}
+			write_u32(pack + PACK_HEADER_SIZE + bank * 4, out);
+			out += length;
+		}
+		write_u32(pack + PACK_HEADER_SIZE + count * 4, out);
+		return out;
+	}
+	set_last_error("p3_pack_chr(): bad arguments");
+	return 0;
+}
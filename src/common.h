@@ -142,48 +142,116 @@ struct mmc_table_state {
 /* Sprite bitmap row on scanline */
 struct sprite_unit {
 	byte attribute;
-	byte chr_lo;
-	byte chr_hi;
 	byte priority;
 	byte x;
+	byte pixels[8];
 };
 
+/* Scanline compositor state, see compositor.c */
+struct compose_state {
+	uint16_t colors[32];
+	byte palette[32];
+	uint16_t tint;
+	byte bg_mask, bg_left_mask;
+	byte obj_mask, obj_left_mask;
+	/* kernel specialized for shown layers */
+	void (*kernel)(uint16_t *dst, const byte *bg, const byte *obj, const struct compose_state *cs);
+};
+
+/* Scanline renderer state, one per band of scanlines */
+struct render_context {
+	/* v register */
+	byte vpg, vcx, vcy, vfx, vfy;
+	/* t register and rendering state, raster table may change them */
+	byte tpg, tcx, tcy, tfx, tfy;
+	padr_t bg_chr_base;
+	padr_t obj_chr_base;
+	BOOL show_bg, show_obj;
+	BOOL clip_bg, clip_obj;
+	byte palette[32];
+	int row;
+	BOOL obj_overflow;
+	sprite_index_t sprite_count;
+	struct sprite_unit sprite_units[OBJ_MAX_PER_SCANLINE];
+	byte cache_aligned sprite_buffer[SCREEN_WIDTH];
+	/* background color indexes of scanline, 33 tile spans */
+	byte cache_aligned bg_buffer[SCREEN_WIDTH + 16];
+	/* scanline compared with previous frame, see frame_change.c */
+	uint16_t cache_aligned line_buffer[SCREEN_WIDTH];
+	struct compose_state cs;
+};
+
+/* Raster event, see raster_event.c */
+struct raster_event {
+	int position;
+	byte x, y;
+	BOOL legacy;
+	P3_CALLBACK proc;
+	void *param;
+};
+
+/* Raster events sorted by position */
+struct event_queue {
+	struct raster_event *items;
+	int count;
+	int capacity;
+};
+
+/* Mapped CHR file, see chr_file.c */
+struct chr_file;
+
+/* Resident banks of paged tileset, see bank_pager.c */
+struct bank_pager;
+
 struct p3_object {
 	/* tileset.c */
 	byte *tileset_pointer;
 	int tileset_size;
+	/* bytes at tileset_pointer, less than tileset_size if banks are paged */
+	int tileset_storage;
+	/* read-only file of tileset, NULL if tileset is owned by caller */
+	struct chr_file *chr_file;
+	/* read-only paged tileset, NULL if whole tileset is in memory */
+	struct bank_pager *pager;
 
 	/* mapper.c */
 	int glob_mmc_mode;
 	cadr_t bank_8x1;
 	/* left table */
 	int left_table_mode;
-	cadr_t left_table_banks[4];
+	cadr_t left_table_banks[8];
 	const byte *left_shift_lut;
 	const padr_t *left_mask_lut;
 	const byte *left_group_lut;
 	/* right table */
 	int right_table_mode;
-	cadr_t right_table_banks[4];
+	cadr_t right_table_banks[8];
 	const byte *right_shift_lut;
 	const padr_t *right_mask_lut;
 	const byte *right_group_lut;
 	/* pointers to tables */
 	struct mmc_table_state mmc_tables[2];
-	/* switchable mapping functions */
-	cadr_t (*main_map_func)(padr_t);
-	cadr_t (*bg_map_func)(padr_t);
-	cadr_t (*obj_map_func)(padr_t);
+	/* tileset address of each 512-byte window of pattern tables and its
+	   offset at tileset_pointer, rebuilt by each change of banks */
+	cadr_t chr_banks[16];
+	cadr_t chr_windows[16];
 	/* mirroring */
 	int mirroring_type;
 	byte mirroring_lut[4];
-	byte(*mirroring_function)(byte);
+	/* offset of each page in page_memory, rebuilt by each change of mirroring */
+	padr_t page_bases[4];
 
 	/* p3.c */
 	int bg_pattern_table;
 	int obj_pattern_table;
 	byte page_memory[4096];
 	P3_SPRITE obj_memory[OBJ_MAX];
+	/* sprites of each scanline in priority order, rows from
+	   obj_dirty_first to obj_dirty_last must be rebuilt */
+	byte obj_bucket_count[SCREEN_HEIGHT];
+	BOOL obj_bucket_overflow[SCREEN_HEIGHT];
+	byte obj_bucket[SCREEN_HEIGHT][OBJ_MAX_PER_SCANLINE];
+	int obj_dirty_first, obj_dirty_last;
 	BOOL idle;
 	BOOL enabled;
 	BOOL show_bg;
@@ -193,7 +261,6 @@ struct p3_object {
 	BOOL fix_obj_y;
 	BOOL callback_enabled;
 	BOOL obj_overflow;
-	sprite_index_t sprite_count;
 	byte tmp_tpg, tmp_tcx, tmp_tcy, tmp_tfx, tmp_tfy;
 	byte tmp_vpg, tmp_vcx, tmp_vcy, tmp_vfx, tmp_vfy;
 	int increment_size;
@@ -220,27 +287,103 @@ struct p3_object {
 	byte *bg_palette;
 	byte *obj_palette;
 	/* frame */
-	size_t frame_pos;
+	uint16_t *frame_line;
 	byte frame_row;
 	uint16_t frame_row_pos;
 	uint16_t frame_buffer[SCREEN_WIDTH * SCREEN_HEIGHT];
-	/* sprites */
-	struct sprite_unit sprite_units[OBJ_MAX_PER_SCANLINE];
-	byte sprite_buffer[SCREEN_WIDTH];
+	/* caller surface, NULL for frame_buffer */
+	byte *render_target;
+	int render_target_stride;
+	/* scanline renderer */
+	struct render_context ctx;
+	/* RGB output of scanlines, set during p3_render_rgb() */
+	byte *rgb_dst;
+	int rgb_stride;
+	int rgb_format;
+	uint32_t rgb_lut[512];
 	/* render callback state */
 	P3_CALLBACK callback_proc;
 	int callback_type;
 	byte callback_x;
 	byte callback_y;
 	void *callback_param;
+	/* per-scanline state, used by renderer without callbacks */
+	const P3_RASTER_LINE *raster_table;
+	/* state generation, changed by each change of state used by renderer */
+	uint32_t generation;
+	/* frame buffer holds frame of frame_generation, see p3_render(),
+	   raster table may be changed in place so frame keeps its copy */
+	BOOL frame_valid;
+	uint32_t frame_generation;
+	P3_RASTER_LINE frame_raster_table[SCREEN_HEIGHT];
+	/* frame rendered by parts, see p3_render_begin() */
+	BOOL frame_open;
+	BOOL frame_cb;
+	int frame_lines;
+
+	/* raster_event.c */
+	struct event_queue raster_events;
+	struct event_queue frame_events;
+	int frame_event_index;
+	int event_position;
+
+	/* frame_change.c */
+	BOOL change_tracking;
+	BOOL row_changed[SCREEN_HEIGHT];
+	byte change_left[SCREEN_HEIGHT];
+	byte change_right[SCREEN_HEIGHT];
 
 	/* attribute_table.c */
 	byte last_attribute_pos;
+
+	/* tile_cache.c */
+	BOOL tile_cache_enabled;
+	byte *tile_cache;
+	byte *tile_cache_valid;
+
+	/* tile_dirty.c */
+	/* bit of each tile changed since it was cleared by caller */
+	byte *dirty_tiles;
+	int dirty_tile_count;
+
+	/* bg_plane.c */
+	BOOL bg_plane_enabled;
+	byte *bg_plane;
+	byte *bg_plane_valid;
+	padr_t bg_plane_chr_base;
+
+	/* ext_attribute.c */
+	BOOL ext_attributes_enabled;
+	/* extended attribute of each tile, same layout as page_memory */
+	byte *ext_memory;
+	/* tileset offset of each 4 KB bank selectable by extended attribute */
+	cadr_t ext_banks[64];
 };
 
-/* Access to global state */
-#define DEFINE_P3_OBJECT                    P3_OBJECT *g_p3obj = NULL
-#define USE_P3_OBJECT                       extern P3_OBJECT *g_p3obj
-#define S(N)                                (g_p3obj->N)
+/* Thread-local storage specifier */
+#if defined(_MSC_VER)
+	#define thread_local __declspec(thread)
+#elif defined(__GNUC__)
+	#define thread_local __thread
+#else
+	#error Unknown compiler
+#endif
+
+/* Access to current object, see current_object.c. Object selected for
+   calling thread takes precedence over object selected for process */
+#define DEFINE_P3_OBJECT                    P3_OBJECT *g_process_p3obj = NULL;\
+                                            thread_local P3_OBJECT *g_thread_p3obj = NULL
+#define USE_P3_OBJECT                       extern P3_OBJECT *g_process_p3obj;\
+                                            extern thread_local P3_OBJECT *g_thread_p3obj
+#define g_p3obj                             (g_thread_p3obj ? g_thread_p3obj : g_process_p3obj)
+
+/* Map pattern table address to tileset offset, see mapper.c */
+#define MAP_CHR_ADDRESS(P, A)               ((P)->chr_windows[((A) >> 9) & 15] | ((A) & 0x1ff))
+
+/* Access to state of object passed in 'p3' */
+#define S(N)                                (p3->N)
+
+/* Mark change of state used by renderer, rendered frame becomes outdated */
+#define STATE_CHANGED()                     (++S(generation))
 
 void set_last_error(const char *err);
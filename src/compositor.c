@@ -0,0 +1,469 @@
+/*
+ Copyright (C) 2019 Dmitry Korunos
+
+ This software is provided 'as-is', without any express or implied
+ warranty. In no event will the authors be held liable for any damages
+ arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it
+ freely, subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+ 2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+ 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "p3.h"
+#include "common.h"
+
+/* SIMD kernels, define P3_NO_SIMD to build scalar compositor only */
+#if !defined(P3_NO_SIMD)
+	#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) ||\
+		(defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+		#define COMPOSE_SSE2
+	#endif
+	/* AVX2 intrinsics: VS2012 and later, GCC 4.9 and later, clang */
+	#if defined(COMPOSE_SSE2) && ((defined(_MSC_VER) && (_MSC_VER >= 1700)) ||\
+		defined(__clang__) ||\
+		(defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))))
+		#define COMPOSE_AVX2
+	#endif
+#endif
+
+#if defined(COMPOSE_SSE2)
+	#include <emmintrin.h>
+#endif
+
+#if defined(COMPOSE_AVX2)
+	#include <immintrin.h>
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+		#define avx2_target
+	#else
+		#define avx2_target __attribute__((target("avx2")))
+	#endif
+#endif
+
+/* Internal interface of module */
+void g_initialize_compositor(void);
+void g_setup_compose_state(struct compose_state *cs, const byte *palette, uint16_t tint,
+                           byte grayscale, BOOL show_bg, BOOL show_obj, BOOL clip_bg, BOOL clip_obj);
+void g_compose_line(uint16_t *dst, const byte *bg, const byte *obj, const struct compose_state *cs);
+void g_build_rgb_lut(uint32_t *lut, int format, const unsigned int *palette);
+void g_convert_line(void *dst, const uint16_t *src, int format, const uint32_t *lut);
+
+/* thread.c module */
+void g_lock_process(void);
+void g_unlock_process(void);
+
+typedef void (*compose_func)(uint16_t *, const byte *, const byte *, const struct compose_state *);
+
+/* Kernels are selected once per process under g_lock_process(), then
+   they are read only by rendering threads */
+static int simd_level = -1;
+static int simd_max_level = P3_SIMD_NONE;
+/* Kernels of selected SIMD level, index is show_bg | show_obj << 1 */
+static compose_func compose_kernels[4];
+
+/* * * * * * * * * * * * * * * * * * Scalar * * * * * * * * * * * * * * * * * */
+
+static forceinline void compose_span_c(uint16_t *dst, const byte *bg, const byte *obj,
+                                       int num, byte bg_mask, byte obj_mask, const uint16_t *colors)
+{
+	byte bg_index, obj_index;
+	int i;
+
+	for (i = 0; i < num; ++i) {
+		bg_index = bg[i] & bg_mask;
+		obj_index = obj[i] & obj_mask;
+		/* Mix color indexes, see write_pixel_cb() */
+		dst[i] = colors[(((obj_index & 0x80) || !(bg_index & 3)) && (obj_index & 3)) ?
+		                obj_index & 0x1F : bg_index];
+	}
+}
+
+/* Specialized span for 'bg' and 'obj' constants, masks of shown layers are identity */
+static forceinline void compose_span_t(uint16_t *dst, const byte *bg, const byte *obj,
+                                       int num, BOOL show_bg, BOOL show_obj, const uint16_t *colors)
+{
+	int i;
+
+	for (i = 0; i < num; ++i) {
+		if (show_bg && show_obj) {
+			dst[i] = colors[(((obj[i] & 0x80) || !(bg[i] & 3)) && (obj[i] & 3)) ?
+			                obj[i] & 0x1F : bg[i]];
+		} else if (show_bg) {
+			dst[i] = colors[bg[i]];
+		} else if (show_obj) {
+			dst[i] = colors[(obj[i] & 3) ? obj[i] & 0x1F : 0];
+		} else {
+			dst[i] = colors[0];
+		}
+	}
+}
+
+/* Clipped pixels always take masked span */
+#define DEFINE_COMPOSE_LINE_C(NAME, SHOW_BG, SHOW_OBJ) \
+	static void NAME(uint16_t *dst, const byte *bg, const byte *obj, const struct compose_state *cs) \
+	{ \
+		compose_span_c(dst, bg, obj, 8, cs->bg_left_mask, cs->obj_left_mask, cs->colors); \
+		compose_span_t(dst + 8, bg + 8, obj + 8, SCREEN_WIDTH - 8, SHOW_BG, SHOW_OBJ, cs->colors); \
+	}
+
+DEFINE_COMPOSE_LINE_C(compose_line_c, TRUE, TRUE)
+DEFINE_COMPOSE_LINE_C(compose_line_c_bg, TRUE, FALSE)
+DEFINE_COMPOSE_LINE_C(compose_line_c_obj, FALSE, TRUE)
+
+/* Both layers hidden, any SIMD level */
+static void compose_line_blank(uint16_t *dst, const byte *bg, const byte *obj, const struct compose_state *cs)
+{
+	uint16_t col = cs->colors[0];
+	int i;
+
+	for (i = 0; i < SCREEN_WIDTH; ++i) {
+		dst[i] = col;
+	}
+}
+
+/* * * * * * * * * * * * * * * * * * * SSE2 * * * * * * * * * * * * * * * * * */
+
+#if defined(COMPOSE_SSE2)
+
+static void compose_line_sse2(uint16_t *dst, const byte *bg, const byte *obj, const struct compose_state *cs)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i m03 = _mm_set1_epi8(0x03);
+	const __m128i m1f = _mm_set1_epi8(0x1F);
+	const __m128i m80 = _mm_set1_epi8((char) 0x80);
+	/* First 16 pixels: eight clipped pixels, then eight regular pixels */
+	__m128i bg_mask = _mm_unpacklo_epi64(_mm_set1_epi8((char) cs->bg_left_mask),
+	                                     _mm_set1_epi8((char) cs->bg_mask));
+	__m128i obj_mask = _mm_unpacklo_epi64(_mm_set1_epi8((char) cs->obj_left_mask),
+	                                      _mm_set1_epi8((char) cs->obj_mask));
+	byte cache_aligned index[16];
+	int i, j;
+
+	for (i = 0; i < SCREEN_WIDTH; i += 16) {
+		__m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i *) (bg + i)), bg_mask);
+		__m128i o = _mm_and_si128(_mm_loadu_si128((const __m128i *) (obj + i)), obj_mask);
+		/* Sprite pixel wins if (front or bg transparent) and opaque */
+		__m128i bg_transparent = _mm_cmpeq_epi8(_mm_and_si128(b, m03), zero);
+		__m128i obj_front = _mm_cmpeq_epi8(_mm_and_si128(o, m80), m80);
+		__m128i obj_transparent = _mm_cmpeq_epi8(_mm_and_si128(o, m03), zero);
+		__m128i sel = _mm_andnot_si128(obj_transparent, _mm_or_si128(obj_front, bg_transparent));
+		__m128i idx = _mm_or_si128(_mm_and_si128(sel, _mm_and_si128(o, m1f)),
+		                           _mm_andnot_si128(sel, b));
+		_mm_store_si128((__m128i *) index, idx);
+		/* No byte shuffle in SSE2, look up colors one by one */
+		for (j = 0; j < 16; ++j) {
+			dst[i + j] = cs->colors[index[j]];
+		}
+		bg_mask = _mm_set1_epi8((char) cs->bg_mask);
+		obj_mask = _mm_set1_epi8((char) cs->obj_mask);
+	}
+}
+
+#endif /* COMPOSE_SSE2 */
+
+/* * * * * * * * * * * * * * * * * * * AVX2 * * * * * * * * * * * * * * * * * */
+
+#if defined(COMPOSE_AVX2)
+
+static avx2_target void compose_line_avx2(uint16_t *dst, const byte *bg, const byte *obj,
+                                          const struct compose_state *cs)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i m03 = _mm256_set1_epi8(0x03);
+	const __m256i m10 = _mm256_set1_epi8(0x10);
+	const __m256i m1f = _mm256_set1_epi8(0x1F);
+	const __m256i m80 = _mm256_set1_epi8((char) 0x80);
+	const __m256i tint = _mm256_set1_epi16((short) cs->tint);
+	/* 32 entry palette as two 16 entry shuffle tables */
+	const __m256i pal_lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) cs->palette));
+	const __m256i pal_hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) (cs->palette + 16)));
+	/* First 32 pixels: eight clipped pixels, then 24 regular pixels */
+	__m256i bg_mask = _mm256_blend_epi32(_mm256_set1_epi8((char) cs->bg_mask),
+	                                     _mm256_set1_epi8((char) cs->bg_left_mask), 0x03);
+	__m256i obj_mask = _mm256_blend_epi32(_mm256_set1_epi8((char) cs->obj_mask),
+	                                      _mm256_set1_epi8((char) cs->obj_left_mask), 0x03);
+	int i;
+
+	for (i = 0; i < SCREEN_WIDTH; i += 32) {
+		__m256i b = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (bg + i)), bg_mask);
+		__m256i o = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (obj + i)), obj_mask);
+		__m256i bg_transparent = _mm256_cmpeq_epi8(_mm256_and_si256(b, m03), zero);
+		__m256i obj_front = _mm256_cmpeq_epi8(_mm256_and_si256(o, m80), m80);
+		__m256i obj_transparent = _mm256_cmpeq_epi8(_mm256_and_si256(o, m03), zero);
+		__m256i sel = _mm256_andnot_si256(obj_transparent, _mm256_or_si256(obj_front, bg_transparent));
+		__m256i idx = _mm256_blendv_epi8(b, _mm256_and_si256(o, m1f), sel);
+		/* Palette lookup, bit 4 of index selects upper half of palette */
+		__m256i hi = _mm256_cmpeq_epi8(_mm256_and_si256(idx, m10), m10);
+		__m256i col = _mm256_blendv_epi8(_mm256_shuffle_epi8(pal_lo, idx),
+		                                 _mm256_shuffle_epi8(pal_hi, idx), hi);
+		/* Widen to 16 bit pixels and apply tint */
+		__m256i lo16 = _mm256_or_si256(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(col)), tint);
+		__m256i hi16 = _mm256_or_si256(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(col, 1)), tint);
+		_mm256_storeu_si256((__m256i *) (dst + i), lo16);
+		_mm256_storeu_si256((__m256i *) (dst + i + 16), hi16);
+		bg_mask = _mm256_set1_epi8((char) cs->bg_mask);
+		obj_mask = _mm256_set1_epi8((char) cs->obj_mask);
+	}
+}
+
+/* Eight LUT entries per gather, RGB565 entries packed to 16 bits */
+static avx2_target void convert_line_avx2(void *dst, const uint16_t *src, int format, const uint32_t *lut)
+{
+	const __m256i m1ff = _mm256_set1_epi32(0x1FF);
+	int i;
+
+	if (format == P3_FORMAT_RGB565) {
+		uint16_t *d = (uint16_t *) dst;
+		for (i = 0; i < SCREEN_WIDTH; i += 16) {
+			__m256i lo = _mm256_and_si256(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (src + i))), m1ff);
+			__m256i hi = _mm256_and_si256(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (src + i + 8))), m1ff);
+			__m256i packed = _mm256_packus_epi32(_mm256_i32gather_epi32((const int *) lut, lo, 4),
+			                                     _mm256_i32gather_epi32((const int *) lut, hi, 4));
+			/* Pack works inside 128 bit lanes, restore pixel order */
+			_mm256_storeu_si256((__m256i *) (d + i), _mm256_permute4x64_epi64(packed, 0xD8));
+		}
+	} else {
+		uint32_t *d = (uint32_t *) dst;
+		for (i = 0; i < SCREEN_WIDTH; i += 8) {
+			__m256i idx = _mm256_and_si256(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (src + i))), m1ff);
+			_mm256_storeu_si256((__m256i *) (d + i), _mm256_i32gather_epi32((const int *) lut, idx, 4));
+		}
+	}
+}
+
+static BOOL cpu_has_avx2(void)
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return FALSE;
+	}
+	/* AVX and OSXSAVE, then OS saves YMM state */
+	__cpuid(info, 1);
+	if ((info[2] & 0x18000000) != 0x18000000) {
+		return FALSE;
+	}
+	if ((_xgetbv(0) & 6) != 6) {
+		return FALSE;
+	}
+	__cpuidex(info, 7, 0);
+	return TO_BOOL(info[1] & (1 << 5));
+#else
+	__builtin_cpu_init();
+	return TO_BOOL(__builtin_cpu_supports("avx2"));
+#endif
+}
+
+#endif /* COMPOSE_AVX2 */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+static void select_kernel(int level)
+{
+	compose_func kernel;
+
+	switch (level) {
+#if defined(COMPOSE_AVX2)
+	case P3_SIMD_AVX2:
+		kernel = compose_line_avx2;
+		break;
+#endif
+#if defined(COMPOSE_SSE2)
+	case P3_SIMD_SSE2:
+		kernel = compose_line_sse2;
+		break;
+#endif
+	default:
+		kernel = NULL;
+		level = P3_SIMD_NONE;
+	}
+	compose_kernels[0] = compose_line_blank;
+	/* Masking costs nothing in SIMD kernels, specialize scalar one only */
+	compose_kernels[1] = kernel ? kernel : compose_line_c_bg;
+	compose_kernels[2] = kernel ? kernel : compose_line_c_obj;
+	compose_kernels[3] = kernel ? kernel : compose_line_c;
+	simd_level = level;
+}
+
+void g_initialize_compositor(void)
+{
+	g_lock_process();
+	if (simd_level < 0) {
+#if defined(COMPOSE_SSE2)
+		simd_max_level = P3_SIMD_SSE2;
+#endif
+#if defined(COMPOSE_AVX2)
+		if (cpu_has_avx2()) {
+			simd_max_level = P3_SIMD_AVX2;
+		}
+#endif
+		select_kernel(simd_max_level);
+	}
+	g_unlock_process();
+}
+
+void g_setup_compose_state(struct compose_state *cs, const byte *palette, uint16_t tint,
+                           byte grayscale, BOOL show_bg, BOOL show_obj, BOOL clip_bg, BOOL clip_obj)
+{
+	int i;
+
+	for (i = 0; i < 32; ++i) {
+		cs->palette[i] = palette[i] & grayscale;
+		cs->colors[i] = tint | cs->palette[i];
+	}
+	cs->tint = tint;
+	cs->bg_mask = show_bg ? 0xFF : 0x00;
+	cs->obj_mask = show_obj ? 0xFF : 0x00;
+	/* Clipping clears color bits of eight leftmost pixels */
+	cs->bg_left_mask = cs->bg_mask & (clip_bg ? 0xF0 : 0xFF);
+	cs->obj_left_mask = cs->obj_mask & (clip_obj ? 0xF0 : 0xFF);
+	cs->kernel = compose_kernels[(show_bg ? 1 : 0) | (show_obj ? 2 : 0)];
+}
+
+void g_compose_line(uint16_t *dst, const byte *bg, const byte *obj, const struct compose_state *cs)
+{
+	cs->kernel(dst, bg, obj, cs);
+}
+
+/* * * * * * * * * * * * * * * * * * RGB output * * * * * * * * * * * * * * * */
+
+/* Common approximation of 2C02 colors, 0xRRGGBB */
+static const unsigned int default_palette[64] = {
+	0x7C7C7C, 0x0000FC, 0x0000BC, 0x4428BC, 0x940084, 0xA80020, 0xA81000, 0x881400,
+	0x503000, 0x007800, 0x006800, 0x005800, 0x004058, 0x000000, 0x000000, 0x000000,
+	0xBCBCBC, 0x0078F8, 0x0058F8, 0x6844FC, 0xD800CC, 0xE40058, 0xF83800, 0xE45C10,
+	0xAC7C00, 0x00B800, 0x00A800, 0x00A844, 0x008888, 0x000000, 0x000000, 0x000000,
+	0xF8F8F8, 0x3CBCFC, 0x6888FC, 0x9878F8, 0xF878F8, 0xF85898, 0xF87858, 0xFCA044,
+	0xF8B800, 0xB8F818, 0x58D854, 0x58F898, 0x00E8D8, 0x787878, 0x000000, 0x000000,
+	0xFCFCFC, 0xA4E4FC, 0xB8B8F8, 0xD8B8F8, 0xF8B8F8, 0xF8A4C0, 0xF0D0B0, 0xFCE0A8,
+	0xF8D878, 0xD8F878, 0xB8F8B8, 0xB8F8D8, 0x00FCFC, 0xF8D8F8, 0x000000, 0x000000
+};
+
+/* Entry for each pixel value, 'palette' is NULL or 512 colors 0xRRGGBB */
+void g_build_rgb_lut(uint32_t *lut, int format, const unsigned int *palette)
+{
+	unsigned int r, g, b, col;
+	byte bytes[4];
+	int i;
+
+	for (i = 0; i < 512; ++i) {
+		if (palette) {
+			col = palette[i];
+		} else {
+			col = default_palette[i & 0x3F];
+		}
+		r = (col >> 16) & 0xFF;
+		g = (col >> 8) & 0xFF;
+		b = col & 0xFF;
+		/* Default emphasis darkens channels which aren't emphasized */
+		if (!palette && (i >> 6)) {
+			if (!(i & (P3_TINT_RED << 6))) r -= r >> 2;
+			if (!(i & (P3_TINT_GREEN << 6))) g -= g >> 2;
+			if (!(i & (P3_TINT_BLUE << 6))) b -= b >> 2;
+			if ((i >> 6) == P3_TINT_DARK) {
+				r -= r >> 2;
+				g -= g >> 2;
+				b -= b >> 2;
+			}
+		}
+		switch (format) {
+		case P3_FORMAT_RGB565:
+			lut[i] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+			break;
+
+		case P3_FORMAT_BGRA8888:
+			bytes[0] = (byte) b;
+			bytes[1] = (byte) g;
+			bytes[2] = (byte) r;
+			bytes[3] = 0xFF;
+			memcpy(&lut[i], bytes, 4);
+			break;
+
+		default:
+			bytes[0] = (byte) r;
+			bytes[1] = (byte) g;
+			bytes[2] = (byte) b;
+			bytes[3] = 0xFF;
+			memcpy(&lut[i], bytes, 4);
+		}
+	}
+}
+
+/* Convert scanline of frame buffer */
+void g_convert_line(void *dst, const uint16_t *src, int format, const uint32_t *lut)
+{
+	int i;
+
+#if defined(COMPOSE_AVX2)
+	if (simd_level == P3_SIMD_AVX2) {
+		convert_line_avx2(dst, src, format, lut);
+		return;
+	}
+#endif
+	if (format == P3_FORMAT_RGB565) {
+		uint16_t *d = (uint16_t *) dst;
+		for (i = 0; i < SCREEN_WIDTH; ++i) {
+			d[i] = (uint16_t) lut[src[i] & 0x1FF];
+		}
+	} else {
+		uint32_t *d = (uint32_t *) dst;
+		for (i = 0; i < SCREEN_WIDTH; ++i) {
+			d[i] = lut[src[i] & 0x1FF];
+		}
+	}
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+int p3_get_simd_level(void)
+{
+	g_initialize_compositor();
+	return simd_level;
+}
+
+/* Kernels are shared by all objects, level must not be changed while
+   any object is rendering */
+void p3_set_simd_level(int level)
+{
+	if ((level >= P3_SIMD_NONE) && (level <= P3_SIMD_AVX2)) {
+		g_initialize_compositor();
+		g_lock_process();
+		/* Fall back to best supported level */
+		select_kernel(level < simd_max_level ? level : simd_max_level);
+		g_unlock_process();
+	} else {
+		set_last_error("p3_set_simd_level(): bad 'level' argument");
+	}
+}
+
+/* Convert 256x240 frame in P3 pixel format, see p3_get_frame_pointer() */
+void p3_convert_frame(void *dst, int stride, int format, const void *palette, const void *src)
+{
+	uint32_t lut[512];
+	int row;
+
+	if (dst && src) {
+		if ((format >= P3_FORMAT_RGBA8888) && (format <= P3_FORMAT_RGB565)) {
+			g_initialize_compositor();
+			g_build_rgb_lut(lut, format, (const unsigned int *) palette);
+			for (row = 0; row < SCREEN_HEIGHT; ++row) {
+				g_convert_line((byte *) dst + row * stride,
+				               (const uint16_t *) src + row * SCREEN_WIDTH, format, lut);
+			}
+		} else {
+			set_last_error("p3_convert_frame(): bad 'format' argument");
+		}
+	} else {
+		set_last_error("p3_convert_frame(): bad arguments");
+	}
+}
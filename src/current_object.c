@@ -0,0 +1,227 @@
+/*
+ Copyright (C) 2019 Dmitry Korunos
+
+ This software is provided 'as-is', without any express or implied
+ warranty. In no event will the authors be held liable for any damages
+ arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it
+ freely, subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+ 2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+ 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "p3.h"
+#include "common.h"
+
+/* Functions working on current object, each one forwards to p3x_ function
+   taking object explicitly, see p3_select_object() and
+   p3_select_thread_object() */
+
+USE_P3_OBJECT;
+
+/* Tileset functions */
+void *p3_get_chr_ptr(void) { return p3x_get_chr_ptr(g_p3obj); }
+void p3_set_chr_ptr(void *chr, int chr_size) { p3x_set_chr_ptr(g_p3obj, chr, chr_size); }
+int p3_get_chr_size(void) { return p3x_get_chr_size(g_p3obj); }
+int p3_get_tile_count(void) { return p3x_get_tile_count(g_p3obj); }
+void *p3_get_tile(int index) { return p3x_get_tile(g_p3obj, index); }
+void p3_put_tile(int index, const void *tile) { p3x_put_tile(g_p3obj, index, tile); }
+void p3_copy_tiles(int dst, int src, int num, int b_mapdst, int b_mapsrc) { p3x_copy_tiles(g_p3obj, dst, src, num, b_mapdst, b_mapsrc); }
+void p3_read_tiles(void *buf, int start, int num, int b_usemmc) { p3x_read_tiles(g_p3obj, buf, start, num, b_usemmc); }
+void p3_write_tiles(const void *tiles, int start, int num, int b_usemmc) { p3x_write_tiles(g_p3obj, tiles, start, num, b_usemmc); }
+int p3_is_tile_cache_enabled(void) { return p3x_is_tile_cache_enabled(g_p3obj); }
+void p3_enable_tile_cache(int flag) { p3x_enable_tile_cache(g_p3obj, flag); }
+int p3_get_dirty_tile_count(void) { return p3x_get_dirty_tile_count(g_p3obj); }
+int p3_is_tile_dirty(int index) { return p3x_is_tile_dirty(g_p3obj, index); }
+int p3_find_dirty_tile(int start) { return p3x_find_dirty_tile(g_p3obj, start); }
+void p3_read_dirty_tiles(void *buf) { p3x_read_dirty_tiles(g_p3obj, buf); }
+void p3_mark_dirty_tiles(int start, int num) { p3x_mark_dirty_tiles(g_p3obj, start, num); }
+void p3_clear_dirty_tiles(int start, int num) { p3x_clear_dirty_tiles(g_p3obj, start, num); }
+int p3_is_bg_plane_enabled(void) { return p3x_is_bg_plane_enabled(g_p3obj); }
+void p3_enable_bg_plane(int flag) { p3x_enable_bg_plane(g_p3obj, flag); }
+int p3_get_bank_faults(void) { return p3x_get_bank_faults(g_p3obj); }
+
+/* Mapper functions */
+int p3_get_mmc_mode(int table) { return p3x_get_mmc_mode(g_p3obj, table); }
+void p3_set_mmc_mode(int table, int mode) { p3x_set_mmc_mode(g_p3obj, table, mode); }
+int p3_get_bank(int table, int bank_adr) { return p3x_get_bank(g_p3obj, table, bank_adr); }
+void p3_set_bank(int table, int bank_adr, int num) { p3x_set_bank(g_p3obj, table, bank_adr, num); }
+void p3_reset_table_banks(int table) { p3x_reset_table_banks(g_p3obj, table); }
+void p3_reset_banks(void) { p3x_reset_banks(g_p3obj); }
+void p3_setup_banks(int bank8k) { p3x_setup_banks(g_p3obj, bank8k); }
+int p3_get_last_banks_setup(void) { return p3x_get_last_banks_setup(g_p3obj); }
+int p3_map_address(int address) { return p3x_map_address(g_p3obj, address); }
+int p3_map_tile(int index) { return p3x_map_tile(g_p3obj, index); }
+int p3_get_mirroring_type(void) { return p3x_get_mirroring_type(g_p3obj); }
+void p3_set_mirroring_type(int type) { p3x_set_mirroring_type(g_p3obj, type); }
+void p3_get_mirroring_lut(int lut[4]) { p3x_get_mirroring_lut(g_p3obj, lut); }
+void p3_set_mirroring_lut(const int lut[4]) { p3x_set_mirroring_lut(g_p3obj, lut); }
+void p3_set_mirroring_lut_4(int tl, int tr, int bl, int br) { p3x_set_mirroring_lut_4(g_p3obj, tl, tr, bl, br); }
+int p3_mirror_page(int page) { return p3x_mirror_page(g_p3obj, page); }
+
+/* P3 functions */
+int p3_is_enabled(void) { return p3x_is_enabled(g_p3obj); }
+void p3_enable(int flag) { p3x_enable(g_p3obj, flag); }
+void p3_reset(int flags) { p3x_reset(g_p3obj, flags); }
+int p3_is_show_bg(void) { return p3x_is_show_bg(g_p3obj); }
+void p3_show_bg(int flag) { p3x_show_bg(g_p3obj, flag); }
+int p3_is_show_obj(void) { return p3x_is_show_obj(g_p3obj); }
+void p3_show_obj(int flag) { p3x_show_obj(g_p3obj, flag); }
+int p3_is_clip_bg(void) { return p3x_is_clip_bg(g_p3obj); }
+void p3_clip_bg(int flag) { p3x_clip_bg(g_p3obj, flag); }
+int p3_is_clip_obj(void) { return p3x_is_clip_obj(g_p3obj); }
+void p3_clip_obj(int flag) { p3x_clip_obj(g_p3obj, flag); }
+int p3_is_grayscale(void) { return p3x_is_grayscale(g_p3obj); }
+void p3_enable_grayscale(int flag) { p3x_enable_grayscale(g_p3obj, flag); }
+int p3_get_tint(void) { return p3x_get_tint(g_p3obj); }
+void p3_set_tint(int tint) { p3x_set_tint(g_p3obj, tint); }
+int p3_get_obj_mode(void) { return p3x_get_obj_mode(g_p3obj); }
+void p3_set_obj_mode(int mode) { p3x_set_obj_mode(g_p3obj, mode); }
+int p3_get_bg_chr_table(void) { return p3x_get_bg_chr_table(g_p3obj); }
+void p3_set_bg_chr_table(int table) { p3x_set_bg_chr_table(g_p3obj, table); }
+int p3_get_obj_chr_table(void) { return p3x_get_obj_chr_table(g_p3obj); }
+void p3_set_obj_chr_table(int table) { p3x_set_obj_chr_table(g_p3obj, table); }
+int p3_get_page(void) { return p3x_get_page(g_p3obj); }
+void p3_set_page(int page) { p3x_set_page(g_p3obj, page); }
+int p3_get_scroll_x(void) { return p3x_get_scroll_x(g_p3obj); }
+void p3_set_scroll_x(int value) { p3x_set_scroll_x(g_p3obj, value); }
+int p3_get_scroll_y(void) { return p3x_get_scroll_y(g_p3obj); }
+void p3_set_scroll_y(int value) { p3x_set_scroll_y(g_p3obj, value); }
+void p3_set_scroll(int x, int y) { p3x_set_scroll(g_p3obj, x, y); }
+void p3_write_obj(const P3_SPRITE *obj) { p3x_write_obj(g_p3obj, obj); }
+P3_SPRITE p3_get_sprite(int index) { return p3x_get_sprite(g_p3obj, index); }
+void p3_put_sprite(int index, const P3_SPRITE *sprite) { p3x_put_sprite(g_p3obj, index, sprite); }
+void p3_reset_sprite(int index) { p3x_reset_sprite(g_p3obj, index); }
+int p3_is_sprite_overflow(void) { return p3x_is_sprite_overflow(g_p3obj); }
+int p3_is_fix_obj_y(void) { return p3x_is_fix_obj_y(g_p3obj); }
+void p3_fix_obj_y(int flag) { p3x_fix_obj_y(g_p3obj, flag); }
+void p3_read_palette(void *buf, int b_bg) { p3x_read_palette(g_p3obj, buf, b_bg); }
+void p3_write_palette(const void *pal, int b_bg) { p3x_write_palette(g_p3obj, pal, b_bg); }
+int p3_get_color(int index) { return p3x_get_color(g_p3obj, index); }
+void p3_set_color(int idx, int col) { p3x_set_color(g_p3obj, idx, col); }
+int p3_get_palette_color(int pal, int col) { return p3x_get_palette_color(g_p3obj, pal, col); }
+void p3_set_palette_color(int pal, int col, int val) { p3x_set_palette_color(g_p3obj, pal, col, val); }
+int p3_get_canvas_color(void) { return p3x_get_canvas_color(g_p3obj); }
+void p3_set_canvas_color(int color) { p3x_set_canvas_color(g_p3obj, color); }
+int p3_get_bg_color(int pal, int col) { return p3x_get_bg_color(g_p3obj, pal, col); }
+void p3_set_bg_color(int pal, int col, int val) { p3x_set_bg_color(g_p3obj, pal, col, val); }
+int p3_get_obj_color(int pal, int col) { return p3x_get_obj_color(g_p3obj, pal, col); }
+void p3_set_obj_color(int pal, int col, int val) { p3x_set_obj_color(g_p3obj, pal, col, val); }
+int p3_get_register(int reg) { return p3x_get_register(g_p3obj, reg); }
+void p3_set_register(int reg, int value) { p3x_set_register(g_p3obj, reg, value); }
+void p3_update_register(int reg) { p3x_update_register(g_p3obj, reg); }
+void p3_save_register(int reg) { p3x_save_register(g_p3obj, reg); }
+void p3_restore_register(int reg) { p3x_restore_register(g_p3obj, reg); }
+int p3_get_increment(void) { return p3x_get_increment(g_p3obj); }
+void p3_set_increment(int inc) { p3x_set_increment(g_p3obj, inc); }
+int p3_get_address(void) { return p3x_get_address(g_p3obj); }
+void p3_set_address(int adr) { p3x_set_address(g_p3obj, adr); }
+int p3_get_byte(void) { return p3x_get_byte(g_p3obj); }
+void p3_put_byte(int value) { p3x_put_byte(g_p3obj, value); }
+int p3_get_byte_at(int adr) { return p3x_get_byte_at(g_p3obj, adr); }
+void p3_put_byte_at(int adr, int val) { p3x_put_byte_at(g_p3obj, adr, val); }
+void p3_read(void *dst, int num) { p3x_read(g_p3obj, dst, num); }
+void p3_write(const void *src, int num) { p3x_write(g_p3obj, src, num); }
+void p3_fill(int val, int num) { p3x_fill(g_p3obj, val, num); }
+void *p3_get_v_pointer(void) { return p3x_get_v_pointer(g_p3obj); }
+int p3_is_callback_enabled(void) { return p3x_is_callback_enabled(g_p3obj); }
+void p3_enable_callback(int flag) { p3x_enable_callback(g_p3obj, flag); }
+P3_CALLBACK p3_get_callback(void) { return p3x_get_callback(g_p3obj); }
+void p3_set_callback(P3_CALLBACK proc, int type, int once_x, int once_y, void *param) { p3x_set_callback(g_p3obj, proc, type, once_x, once_y, param); }
+void p3_adjust_callback(int type, int once_x, int once_y) { p3x_adjust_callback(g_p3obj, type, once_x, once_y); }
+void p3_reset_callback(void) { p3x_reset_callback(g_p3obj); }
+const P3_RASTER_LINE *p3_get_raster_table(void) { return p3x_get_raster_table(g_p3obj); }
+void p3_set_raster_table(const P3_RASTER_LINE *table) { p3x_set_raster_table(g_p3obj, table); }
+int p3_get_raster_event_count(void) { return p3x_get_raster_event_count(g_p3obj); }
+void p3_add_raster_event(int x, int y, P3_CALLBACK proc, void *param) { p3x_add_raster_event(g_p3obj, x, y, proc, param); }
+void p3_clear_raster_events(void) { p3x_clear_raster_events(g_p3obj); }
+void p3_refetch_tile(void) { p3x_refetch_tile(g_p3obj); }
+int p3_render(void) { return p3x_render(g_p3obj); }
+int p3_render_parallel(int nthreads) { return p3x_render_parallel(g_p3obj, nthreads); }
+void p3_touch(void) { p3x_touch(g_p3obj); }
+void p3_render_begin(void) { p3x_render_begin(g_p3obj); }
+void p3_render_lines(int num) { p3x_render_lines(g_p3obj, num); }
+void p3_render_end(void) { p3x_render_end(g_p3obj); }
+int p3_get_rendered_lines(void) { return p3x_get_rendered_lines(g_p3obj); }
+void p3_render_rgb(void *dst, int stride, int format, const void *palette) { p3x_render_rgb(g_p3obj, dst, stride, format, palette); }
+const void *p3_get_frame_pointer(void) { return p3x_get_frame_pointer(g_p3obj); }
+int p3_is_change_tracking_enabled(void) { return p3x_is_change_tracking_enabled(g_p3obj); }
+void p3_enable_change_tracking(int flag) { p3x_enable_change_tracking(g_p3obj, flag); }
+void p3_get_changed_rows(void *mask) { p3x_get_changed_rows(g_p3obj, mask); }
+int p3_get_changed_rects(P3_RECT *rects, int count) { return p3x_get_changed_rects(g_p3obj, rects, count); }
+void p3_set_render_target(void *ptr, int stride, int x, int y) { p3x_set_render_target(g_p3obj, ptr, stride, x, y); }
+
+/* Tile utils */
+int p3_make_tile_index_1m(int index) { return p3x_make_tile_index_1m(g_p3obj, index); }
+int p3_make_tile_index_1t(int table, int index) { return p3x_make_tile_index_1t(g_p3obj, table, index); }
+int p3_make_tile_index_1tm(int table, int index) { return p3x_make_tile_index_1tm(g_p3obj, table, index); }
+int p3_make_tile_index_2(int x, int y) { return p3x_make_tile_index_2(g_p3obj, x, y); }
+int p3_make_tile_index_2m(int x, int y) { return p3x_make_tile_index_2m(g_p3obj, x, y); }
+int p3_make_tile_index_2t(int table, int x, int y) { return p3x_make_tile_index_2t(g_p3obj, table, x, y); }
+int p3_make_tile_index_2tm(int table, int x, int y) { return p3x_make_tile_index_2tm(g_p3obj, table, x, y); }
+
+/* Page utils */
+void p3_zero_page(int page) { p3x_zero_page(g_p3obj, page); }
+void p3_fill_page(int page, int tile, int pal) { p3x_fill_page(g_p3obj, page, tile, pal); }
+void p3_read_page(int page, void *buf) { p3x_read_page(g_p3obj, page, buf); }
+void p3_write_page(int page, const void *data) { p3x_write_page(g_p3obj, page, data); }
+
+/* Nametable utils */
+void p3_fill_nametable(int page, int tile) { p3x_fill_nametable(g_p3obj, page, tile); }
+void p3_zero_nametable(int page) { p3x_zero_nametable(g_p3obj, page); }
+void p3_fill_nametable_row_2(int page, int row, int tile, int start, int end) { p3x_fill_nametable_row_2(g_p3obj, page, row, tile, start, end); }
+void p3_fill_nametable_row(int page, int row, int tile) { p3x_fill_nametable_row(g_p3obj, page, row, tile); }
+void p3_fill_nametable_column_2(int page, int col, int tile, int start, int end) { p3x_fill_nametable_column_2(g_p3obj, page, col, tile, start, end); }
+void p3_fill_nametable_column(int page, int col, int tile) { p3x_fill_nametable_column(g_p3obj, page, col, tile); }
+void p3_read_nametable(int page, void *buf) { p3x_read_nametable(g_p3obj, page, buf); }
+void p3_write_nametable(int page, const void *data) { p3x_write_nametable(g_p3obj, page, data); }
+int p3_get_name(int index) { return p3x_get_name(g_p3obj, index); }
+void p3_put_name(int index, int tile) { p3x_put_name(g_p3obj, index, tile); }
+int p3_get_name_1t(int page, int index) { return p3x_get_name_1t(g_p3obj, page, index); }
+void p3_put_name_1t(int page, int index, int tile) { p3x_put_name_1t(g_p3obj, page, index, tile); }
+int p3_get_name_2(int x, int y) { return p3x_get_name_2(g_p3obj, x, y); }
+void p3_put_name_2(int x, int y, int tile) { p3x_put_name_2(g_p3obj, x, y, tile); }
+int p3_get_name_2t(int page, int x, int y) { return p3x_get_name_2t(g_p3obj, page, x, y); }
+void p3_put_name_2t(int page, int x, int y, int tile) { p3x_put_name_2t(g_p3obj, page, x, y, tile); }
+
+/* Attribute table utils */
+void p3_fill_attribute_table(int page, int pal) { p3x_fill_attribute_table(g_p3obj, page, pal); }
+void p3_zero_attribute_table(int page) { p3x_zero_attribute_table(g_p3obj, page); }
+void p3_fill_attribute_table_row_2(int page, int row, int pal, int start, int end) { p3x_fill_attribute_table_row_2(g_p3obj, page, row, pal, start, end); }
+void p3_fill_attribute_table_row(int page, int row, int pal) { p3x_fill_attribute_table_row(g_p3obj, page, row, pal); }
+void p3_fill_attribute_table_column_2(int page, int col, int pal, int start, int end) { p3x_fill_attribute_table_column_2(g_p3obj, page, col, pal, start, end); }
+void p3_fill_attribute_table_column(int page, int col, int pal) { p3x_fill_attribute_table_column(g_p3obj, page, col, pal); }
+void p3_read_attribute_table(int page, void *buf) { p3x_read_attribute_table(g_p3obj, page, buf); }
+void p3_write_attribute_table(int page, const void *data) { p3x_write_attribute_table(g_p3obj, page, data); }
+int p3_get_attribute_position(void) { return p3x_get_attribute_position(g_p3obj); }
+int p3_make_attribute_address(int index) { return p3x_make_attribute_address(g_p3obj, index); }
+int p3_make_attribute_address_1t(int page, int index) { return p3x_make_attribute_address_1t(g_p3obj, page, index); }
+int p3_make_attribute_address_2(int x, int y) { return p3x_make_attribute_address_2(g_p3obj, x, y); }
+int p3_make_attribute_address_2t(int page, int x, int y) { return p3x_make_attribute_address_2t(g_p3obj, page, x, y); }
+int p3_get_attribute(int index) { return p3x_get_attribute(g_p3obj, index); }
+void p3_put_attribute(int index, int pal) { p3x_put_attribute(g_p3obj, index, pal); }
+int p3_get_attribute_1t(int page, int index) { return p3x_get_attribute_1t(g_p3obj, page, index); }
+void p3_put_attribute_1t(int page, int index, int pal) { p3x_put_attribute_1t(g_p3obj, page, index, pal); }
+int p3_get_attribute_2(int x, int y) { return p3x_get_attribute_2(g_p3obj, x, y); }
+void p3_put_attribute_2(int x, int y, int pal) { p3x_put_attribute_2(g_p3obj, x, y, pal); }
+int p3_get_attribute_2t(int page, int x, int y) { return p3x_get_attribute_2t(g_p3obj, page, x, y); }
+void p3_put_attribute_2t(int page, int x, int y, int pal) { p3x_put_attribute_2t(g_p3obj, page, x, y, pal); }
+int p3_get_attribute_byte_item_x(int attr) { return p3x_get_attribute_byte_item_x(g_p3obj, attr); }
+int p3_set_attribute_byte_item_x(int attr, int pal) { return p3x_set_attribute_byte_item_x(g_p3obj, attr, pal); }
+
+/* Extended attributes */
+int p3_is_ext_attributes_enabled(void) { return p3x_is_ext_attributes_enabled(g_p3obj); }
+void p3_enable_ext_attributes(int flag) { p3x_enable_ext_attributes(g_p3obj, flag); }
+int p3_get_ext_attribute_2t(int page, int x, int y) { return p3x_get_ext_attribute_2t(g_p3obj, page, x, y); }
+void p3_put_ext_attribute_2t(int page, int x, int y, int ext) { p3x_put_ext_attribute_2t(g_p3obj, page, x, y, ext); }
+void p3_read_ext_attributes(int page, void *buf) { p3x_read_ext_attributes(g_p3obj, page, buf); }
+void p3_write_ext_attributes(int page, const void *data) { p3x_write_ext_attributes(g_p3obj, page, data); }
+void p3_fill_ext_attributes(int page, int ext) { p3x_fill_ext_attributes(g_p3obj, page, ext); }
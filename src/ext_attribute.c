@@ -0,0 +1,154 @@
+/*
+ Copyright (C) 2019 Dmitry Korunos
+
+ This software is provided 'as-is', without any express or implied
+ warranty. In no event will the authors be held liable for any damages
+ arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it
+ freely, subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+ 2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+ 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "p3.h"
+#include "common.h"
+
+/* Internal interface of module */
+void g_update_ext_banks(P3_OBJECT *p3);
+void g_release_ext_attributes(P3_OBJECT *obj);
+void g_copy_ext_attributes(P3_OBJECT *dst);
+
+/* bg_plane.c module */
+void g_invalidate_bg_plane(P3_OBJECT *obj);
+void g_invalidate_bg_plane_byte(P3_OBJECT *obj, padr_t address);
+
+/* Extended attribute byte of tile: bits 7-6 are palette, bits 5-0 are
+   4 KB bank of tileset. Memory has same layout as page_memory, byte of
+   each tile of nametable, bytes 960..1023 of pages are unused */
+#define EXT_MEMORY_SIZE                     4096
+#define EXT_BANK_SHIFT                      12
+
+/* Bank out of tileset wraps around, like mirrored CHR-ROM */
+void g_update_ext_banks(P3_OBJECT *p3)
+{
+	int count = S(tileset_storage) >> EXT_BANK_SHIFT;
+	int i;
+
+	for (i = 0; i < 64; ++i) {
+		S(ext_banks)[i] = (cadr_t) (count ? i % count : 0) << EXT_BANK_SHIFT;
+	}
+}
+
+void g_release_ext_attributes(P3_OBJECT *obj)
+{
+	free(obj->ext_memory);
+	obj->ext_memory = NULL;
+}
+
+/* Object copy gets own copy of extended attributes */
+void g_copy_ext_attributes(P3_OBJECT *dst)
+{
+	const byte *src = dst->ext_memory;
+
+	if (src) {
+		dst->ext_memory = (byte *) malloc(EXT_MEMORY_SIZE);
+		if (dst->ext_memory) {
+			memcpy(dst->ext_memory, src, EXT_MEMORY_SIZE);
+		} else {
+			set_last_error("p3_copy_object(): out of memory, extended attributes disabled");
+			dst->ext_attributes_enabled = FALSE;
+		}
+	}
+}
+
+/* Memory is allocated by first enable or write and kept until object is destroyed */
+static BOOL prepare_ext_memory(P3_OBJECT *p3, const char *err)
+{
+	if (!S(ext_memory)) {
+		S(ext_memory) = (byte *) calloc(EXT_MEMORY_SIZE, 1);
+		if (!S(ext_memory)) {
+			set_last_error(err);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+int p3x_is_ext_attributes_enabled(P3_OBJECT *p3) { return S(ext_attributes_enabled); }
+
+/* Background tiles take palette and 4 KB bank from extended attributes
+   instead of attribute table and pattern table banks. Not supported for
+   paged tileset, since banks aren't selected by mapper */
+void p3x_enable_ext_attributes(P3_OBJECT *p3, int flag)
+{
+	if (S(idle)) {
+		if (flag && S(pager)) {
+			set_last_error("p3_enable_ext_attributes(): paged tileset isn't supported");
+		} else if (!flag || prepare_ext_memory(p3, "p3_enable_ext_attributes(): out of memory")) {
+			S(ext_attributes_enabled) = TO_BOOL(flag);
+			g_update_ext_banks(p3);
+			STATE_CHANGED();
+			g_invalidate_bg_plane(p3);
+		}
+	}
+}
+
+int p3x_get_ext_attribute_2t(P3_OBJECT *p3, int page, int x, int y)
+{
+	return S(ext_memory) ? S(ext_memory)[S(page_bases)[page & 3] | p3_make_name_address_2t(0, x, y)] : 0;
+}
+
+void p3x_put_ext_attribute_2t(P3_OBJECT *p3, int page, int x, int y, int ext)
+{
+	if (prepare_ext_memory(p3, "p3_put_ext_attribute_2t(): out of memory")) {
+		padr_t address = S(page_bases)[page & 3] | p3_make_name_address_2t(0, x, y);
+		S(ext_memory)[address] = ext & 0xff;
+		STATE_CHANGED();
+		g_invalidate_bg_plane_byte(p3, address);
+	}
+}
+
+void p3x_read_ext_attributes(P3_OBJECT *p3, int page, void *buf)
+{
+	if (buf) {
+		if (S(ext_memory)) {
+			memcpy(buf, S(ext_memory) + S(page_bases)[page & 3], 960);
+		} else {
+			memset(buf, 0, 960);
+		}
+	} else {
+		set_last_error("p3_read_ext_attributes(): bad 'buf' argument");
+	}
+}
+
+void p3x_write_ext_attributes(P3_OBJECT *p3, int page, const void *data)
+{
+	if (data) {
+		if (prepare_ext_memory(p3, "p3_write_ext_attributes(): out of memory")) {
+			memcpy(S(ext_memory) + S(page_bases)[page & 3], data, 960);
+			STATE_CHANGED();
+			g_invalidate_bg_plane(p3);
+		}
+	} else {
+		set_last_error("p3_write_ext_attributes(): bad 'data' argument");
+	}
+}
+
+void p3x_fill_ext_attributes(P3_OBJECT *p3, int page, int ext)
+{
+	if (prepare_ext_memory(p3, "p3_fill_ext_attributes(): out of memory")) {
+		memset(S(ext_memory) + S(page_bases)[page & 3], ext & 0xff, 960);
+		STATE_CHANGED();
+		g_invalidate_bg_plane(p3);
+	}
+}
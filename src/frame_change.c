@@ -0,0 +1,136 @@
+/*
+ Copyright (C) 2019 Dmitry Korunos
+
+ This software is provided 'as-is', without any express or implied
+ warranty. In no event will the authors be held liable for any damages
+ arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it
+ freely, subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+ 2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+ 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "p3.h"
+#include "common.h"
+
+/* Internal interface of module */
+void g_reset_changes(P3_OBJECT *obj);
+void g_commit_line(P3_OBJECT *obj, int row, const uint16_t *line, uint16_t *dst);
+
+void g_reset_changes(P3_OBJECT *obj)
+{
+	memset(obj->row_changed, FALSE, sizeof(obj->row_changed));
+}
+
+/* Compare scanline with scanline of previous frame and copy changed pixels */
+void g_commit_line(P3_OBJECT *obj, int row, const uint16_t *line, uint16_t *dst)
+{
+	int left, right;
+
+	if (!memcmp(line, dst, SCREEN_WIDTH * sizeof(uint16_t))) {
+		obj->row_changed[row] = FALSE;
+		return;
+	}
+	left = 0;
+	while (line[left] == dst[left]) {
+		++left;
+	}
+	right = SCREEN_WIDTH - 1;
+	while (line[right] == dst[right]) {
+		--right;
+	}
+	memcpy(dst + left, line + left, (right - left + 1) * sizeof(uint16_t));
+	obj->row_changed[row] = TRUE;
+	obj->change_left[row] = (byte) left;
+	obj->change_right[row] = (byte) right;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+int p3x_is_change_tracking_enabled(P3_OBJECT *p3) { return S(change_tracking); }
+
+/* Renderer compares each scanline with previous frame, rows of frame not
+   rendered yet and frames rendered without tracking are unchanged */
+void p3x_enable_change_tracking(P3_OBJECT *p3, int flag)
+{
+	if (S(idle)) {
+		S(change_tracking) = TO_BOOL(flag);
+		g_reset_changes(p3);
+	}
+}
+
+/* Bit (row & 7) of byte (row >> 3) is set for changed row */
+void p3x_get_changed_rows(P3_OBJECT *p3, void *mask)
+{
+	if (mask) {
+		byte *dst = (byte *) mask;
+		int row;
+		memset(dst, 0, P3_CHANGE_MASK_SIZE);
+		for (row = 0; row < SCREEN_HEIGHT; ++row) {
+			if (S(row_changed)[row]) {
+				dst[row >> 3] |= 1 << (row & 7);
+			}
+		}
+	} else {
+		set_last_error("p3_get_changed_rows(): bad 'mask' argument");
+	}
+}
+
+/* Adjacent changed rows are joined in one rectangle, last rectangle covers
+   the rest if there are more than 'count'. Returns number of rectangles */
+int p3x_get_changed_rects(P3_OBJECT *p3, P3_RECT *rects, int count)
+{
+	int num = 0;
+	int row = 0;
+
+	if (!rects || (count <= 0)) {
+		set_last_error("p3_get_changed_rects(): bad arguments");
+		return 0;
+	}
+	while (row < SCREEN_HEIGHT) {
+		int left, right, top;
+		if (!S(row_changed)[row]) {
+			++row;
+			continue;
+		}
+		top = row;
+		left = S(change_left)[row];
+		right = S(change_right)[row];
+		for (++row; (row < SCREEN_HEIGHT) && S(row_changed)[row]; ++row) {
+			if (S(change_left)[row] < left) {
+				left = S(change_left)[row];
+			}
+			if (S(change_right)[row] > right) {
+				right = S(change_right)[row];
+			}
+		}
+		if (num == count) {
+			/* Extend last rectangle */
+			P3_RECT *last = &rects[num - 1];
+			int last_right = last->x + last->width - 1;
+			if (left < last->x) {
+				last->x = left;
+			}
+			if (right > last_right) {
+				last_right = right;
+			}
+			last->width = last_right - last->x + 1;
+			last->height = row - last->y;
+		} else {
+			rects[num].x = left;
+			rects[num].y = top;
+			rects[num].width = right - left + 1;
+			rects[num].height = row - top;
+			++num;
+		}
+	}
+	return num;
+}
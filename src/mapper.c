@@ -24,123 +24,159 @@
 USE_P3_OBJECT;
 
 /* Internal interface of module */
-void g_initialize_mapper(void);
-void g_update_mapper_fn(void);
-byte *g_get_tile(padr_t);
-byte *g_get_bg_tile(padr_t);
-byte *g_get_obj_tile(padr_t);
-CHECK_LINE(void g_check_banks();)
+void g_initialize_mapper(P3_OBJECT *p3);
+void g_update_mapper_fn(P3_OBJECT *p3);
+cadr_t g_map_tile_address(P3_OBJECT *p3, padr_t);
+int g_map_tile_run(P3_OBJECT *p3, int index, int *tile);
+CHECK_LINE(void g_check_banks(P3_OBJECT *p3);)
 
-/* Forward */
-static void convert_banks(int from, int to, cadr_t *banks);
+/* bank_pager.c module */
+cadr_t g_page_chr_address(P3_OBJECT *p3, cadr_t address);
+
+/* bg_plane.c module */
+void g_invalidate_bg_plane(P3_OBJECT *obj);
 
 #define MMC_MODE_SKIP 0
 #define MMC_MODE_BANK_8 1
 #define MMC_MODE_TABS 2
 
+/* Modes split pattern table to eight 512-byte segments, bank of mode
+   covers one or more segments */
+#define MMC_MODE_COUNT 6
+#define SEGMENT_SHIFT 9
+
 /* Used for conversion: bank number <-> base memory address */
-static const byte shift_luts[5][4] = {
-	{ 12, 12, 12, 12 },
-	{ 11, 11, 11, 11 },
-	{ 11, 11, 10, 10 },
-	{ 10, 10, 11, 11 },
-	{ 10, 10, 10, 10 }
+static const byte shift_luts[MMC_MODE_COUNT][8] = {
+	{ 12, 12, 12, 12, 12, 12, 12, 12 },
+	{ 11, 11, 11, 11, 11, 11, 11, 11 },
+	{ 11, 11, 11, 11, 10, 10, 10, 10 },
+	{ 10, 10, 10, 10, 11, 11, 11, 11 },
+	{ 10, 10, 10, 10, 10, 10, 10, 10 },
+	{ 9, 9, 9, 9, 9, 9, 9, 9 }
 };
 
 /* Used to mask bits of input memory address */
-static const padr_t mask_luts[5][4] = {
-	{ 0x0FFF, 0x0FFF, 0x0FFF, 0x0FFF },
-	{ 0x07FF, 0x07FF, 0x07FF, 0x07FF },
-	{ 0x07FF, 0x07FF, 0x03FF, 0x03FF },
-	{ 0x03FF, 0x03FF, 0x07FF, 0x07FF },
-	{ 0x03FF, 0x03FF, 0x03FF, 0x03FF }
+static const padr_t mask_luts[MMC_MODE_COUNT][8] = {
+	{ 0x0FFF, 0x0FFF, 0x0FFF, 0x0FFF, 0x0FFF, 0x0FFF, 0x0FFF, 0x0FFF },
+	{ 0x07FF, 0x07FF, 0x07FF, 0x07FF, 0x07FF, 0x07FF, 0x07FF, 0x07FF },
+	{ 0x07FF, 0x07FF, 0x07FF, 0x07FF, 0x03FF, 0x03FF, 0x03FF, 0x03FF },
+	{ 0x03FF, 0x03FF, 0x03FF, 0x03FF, 0x07FF, 0x07FF, 0x07FF, 0x07FF },
+	{ 0x03FF, 0x03FF, 0x03FF, 0x03FF, 0x03FF, 0x03FF, 0x03FF, 0x03FF },
+	{ 0x01FF, 0x01FF, 0x01FF, 0x01FF, 0x01FF, 0x01FF, 0x01FF, 0x01FF }
 };
 
-/* Used to group 1 KB banks to larger banks */
-static const byte group_luts[5][4] = {
-	{ P3_BANK_0K, P3_BANK_0K, P3_BANK_0K, P3_BANK_0K },
-	{ P3_BANK_0K, P3_BANK_0K, P3_BANK_2K, P3_BANK_2K },
-	{ P3_BANK_0K, P3_BANK_0K, P3_BANK_2K, P3_BANK_3K },
-	{ P3_BANK_0K, P3_BANK_1K, P3_BANK_2K, P3_BANK_2K },
-	{ P3_BANK_0K, P3_BANK_1K, P3_BANK_2K, P3_BANK_3K }
+/* Used to group segments to banks, bank address is start of bank in KB,
+   or number of 512-byte bank in P3_MMC_MODE_05X8 */
+static const byte group_luts[MMC_MODE_COUNT][8] = {
+	{ P3_BANK_0K, P3_BANK_0K, P3_BANK_0K, P3_BANK_0K, P3_BANK_0K, P3_BANK_0K, P3_BANK_0K, P3_BANK_0K },
+	{ P3_BANK_0K, P3_BANK_0K, P3_BANK_0K, P3_BANK_0K, P3_BANK_2K, P3_BANK_2K, P3_BANK_2K, P3_BANK_2K },
+	{ P3_BANK_0K, P3_BANK_0K, P3_BANK_0K, P3_BANK_0K, P3_BANK_2K, P3_BANK_2K, P3_BANK_3K, P3_BANK_3K },
+	{ P3_BANK_0K, P3_BANK_0K, P3_BANK_1K, P3_BANK_1K, P3_BANK_2K, P3_BANK_2K, P3_BANK_2K, P3_BANK_2K },
+	{ P3_BANK_0K, P3_BANK_0K, P3_BANK_1K, P3_BANK_1K, P3_BANK_2K, P3_BANK_2K, P3_BANK_3K, P3_BANK_3K },
+	{ 0, 1, 2, 3, 4, 5, 6, 7 }
 };
 
+/* Number of bank addresses of pattern table */
+static const byte bank_address_counts[MMC_MODE_COUNT] = { 4, 4, 4, 4, 4, 8 };
+
 /* Initial setup of bank numbers to first 8 KB of tileset */
-static const cadr_t setup_banks_data[2][5][4] = {
-	{ {0, 0, 0, 0}, {0, 0, 1, 1}, {0, 0, 2, 3}, {0, 1, 1, 1}, {0, 1, 2, 3} },
-	{ {1, 1, 1, 1}, {2, 2, 3, 3}, {2, 2, 6, 7}, {4, 5, 3, 3}, {4, 5, 6, 7} }
+static const cadr_t setup_banks_data[2][MMC_MODE_COUNT][8] = {
+	{
+		{0, 0, 0, 0, 0, 0, 0, 0}, {0, 0, 0, 0, 1, 1, 1, 1}, {0, 0, 0, 0, 2, 2, 3, 3},
+		{0, 0, 1, 1, 1, 1, 1, 1}, {0, 0, 1, 1, 2, 2, 3, 3}, {0, 1, 2, 3, 4, 5, 6, 7}
+	},
+	{
+		{1, 1, 1, 1, 1, 1, 1, 1}, {2, 2, 2, 2, 3, 3, 3, 3}, {2, 2, 2, 2, 6, 6, 7, 7},
+		{4, 4, 5, 5, 3, 3, 3, 3}, {4, 4, 5, 5, 6, 6, 7, 7}, {8, 9, 10, 11, 12, 13, 14, 15}
+	}
 };
 
 /* Bank scale relative to 8 KB bank */
-static const byte banking_mode_scale[5][4] = {
-	{2, 2, 2, 2}, {4, 4, 4, 4}, {4, 4, 8, 8}, {8, 8, 4, 4}, {8, 8, 8, 8}
+static const byte banking_mode_scale[MMC_MODE_COUNT][8] = {
+	{2, 2, 2, 2, 2, 2, 2, 2}, {4, 4, 4, 4, 4, 4, 4, 4}, {4, 4, 4, 4, 8, 8, 8, 8},
+	{8, 8, 8, 8, 4, 4, 4, 4}, {8, 8, 8, 8, 8, 8, 8, 8}, {16, 16, 16, 16, 16, 16, 16, 16}
 };
 
 /* MMC_MODE_SKIP */
-static cadr_t skip_mapping(padr_t address) { return address; }
+static cadr_t skip_mapping(P3_OBJECT *p3, padr_t address) { return address; }
 
 /* MMC_MODE_BANK_8 */
-static cadr_t map_address_8(padr_t address) { return S(bank_8x1) | address; }
+static cadr_t map_address_8(P3_OBJECT *p3, padr_t address) { return S(bank_8x1) | address; }
 
 /* MMC_MODE_TABS */
-static cadr_t map_left_table_address(padr_t address)
+static cadr_t map_left_table_address(P3_OBJECT *p3, padr_t address)
 {
-	/* Round down input address to 1 KB segment, 0..3 */
-	byte segment = (address >> 10) & 3;
+	/* Round down input address to 512-byte segment, 0..7 */
+	byte segment = (address >> SEGMENT_SHIFT) & 7;
 	/* Compose address */
 	return S(left_table_banks)[segment] | (address & S(left_mask_lut)[segment]);
 }
 
 /* MMC_MODE_TABS */
-static cadr_t map_right_table_address(padr_t address)
+static cadr_t map_right_table_address(P3_OBJECT *p3, padr_t address)
 {
-	/* Round down input address to 1 KB segment, 0..3 */
-	byte segment = (address >> 10) & 3;
+	/* Round down input address to 512-byte segment, 0..7 */
+	byte segment = (address >> SEGMENT_SHIFT) & 7;
 	/* Compose address */
 	return S(right_table_banks)[segment] | (address & S(right_mask_lut)[segment]);
 }
 
-static cadr_t(* const map_func_lut[2])(padr_t) = {
-	map_left_table_address, map_right_table_address
-};
-
-static cadr_t map_address(padr_t address)
+static cadr_t map_address(P3_OBJECT *p3, padr_t address)
 {
 	return (address & 0x1000) ?
-	       map_right_table_address(address) : map_left_table_address(address);
+	       map_right_table_address(p3, address) : map_left_table_address(p3, address);
+}
+
+/* Mapping functions are used only to rebuild windows, fetch of tile
+   takes base address of its 512-byte window. Banks of paged tileset are
+   loaded here, all banks of windows are resident during rendering */
+static void update_chr_windows(P3_OBJECT *p3)
+{
+	cadr_t (*map)(P3_OBJECT *, padr_t) = skip_mapping;
+	int i;
+
+	if (S(glob_mmc_mode) == MMC_MODE_BANK_8) {
+		map = map_address_8;
+	} else if (S(glob_mmc_mode) == MMC_MODE_TABS) {
+		map = map_address;
+	}
+	for (i = 0; i < 16; ++i) {
+		S(chr_banks)[i] = map(p3, (padr_t) (i << SEGMENT_SHIFT));
+	}
+	for (i = 0; i < 16; ++i) {
+		S(chr_windows)[i] = S(pager) ? g_page_chr_address(p3, S(chr_banks)[i]) : S(chr_banks)[i];
+	}
 }
 
-byte *g_get_tile(padr_t address) {	return &S(tileset_pointer)[S(main_map_func)(address)]; }
-byte *g_get_bg_tile(padr_t address) { return &S(tileset_pointer)[S(bg_map_func)(address)]; }
-byte *g_get_obj_tile(padr_t address) { return &S(tileset_pointer)[S(obj_map_func)(address)]; }
+cadr_t g_map_tile_address(P3_OBJECT *p3, padr_t address) { return MAP_CHR_ADDRESS(p3, address); }
 
 #ifdef P3_CHECKED
 
-static void check_table_banks(int pattern_table)
+static void check_table_banks(P3_OBJECT *p3, int pattern_table)
 {
 	const struct mmc_table_state *table = &S(mmc_tables)[pattern_table];
 	cadr_t *banks = table->banks;
 	const padr_t *mask = *table->mask;
 	int i;
-	for (i = 0; i < 4; ++i) {
+	for (i = 0; i < 8; ++i) {
 		/* Check using max input address */
 		assert((banks[i] | (0x1fff & mask[i])) < (unsigned) S(tileset_size));
 	}
 }
 
-void g_check_banks(void)
+void g_check_banks(P3_OBJECT *p3)
 {
 	if (S(glob_mmc_mode) == MMC_MODE_BANK_8) {
 		assert((S(bank_8x1) >> 13) < (unsigned)(S(tileset_size) >> 13));
 	} else if (S(glob_mmc_mode) == MMC_MODE_TABS) {
-		check_table_banks(P3_CHR_TABLE_LEFT);
-		check_table_banks(P3_CHR_TABLE_RIGHT);
+		check_table_banks(p3, P3_CHR_TABLE_LEFT);
+		check_table_banks(p3, P3_CHR_TABLE_RIGHT);
 	}
 }
 
 #endif /* P3_CHECKED */
 
-static void set_banking_mode(int pattern_table, int mode)
+static void set_banking_mode(P3_OBJECT *p3, int pattern_table, int mode)
 {
 	const struct mmc_table_state *table = &S(mmc_tables)[pattern_table];
 	/* Setup lookup mmc_tables */
@@ -150,38 +186,37 @@ static void set_banking_mode(int pattern_table, int mode)
 	*table->group = group_luts[mode];
 }
 
-static void convert_table_banks(int pattern_table, int mode)
+/* Bank of new mode takes address of its first segment in old mode */
+static void convert_table_banks(P3_OBJECT *p3, int pattern_table, int mode)
 {
 	const struct mmc_table_state *table = &S(mmc_tables)[pattern_table];
 	if (*table->mode != mode) {
 		cadr_t *banks = table->banks;
-		const byte *shift = *table->shift;
+		const padr_t *mask = *table->mask;
+		cadr_t segments[8];
 		int i;
-		/* Convert base address to bank number */
-		for (i = 0; i < 4; ++i) {
-			banks[i] >>= shift[i];
+		/* Tileset address of each segment */
+		for (i = 0; i < 8; ++i) {
+			segments[i] = banks[i] | ((i << SEGMENT_SHIFT) & mask[i]);
 		}
-		/* Convert bank numbers */
-		convert_banks(*table->mode, mode, banks);
 		/* Set new banking mode */
-		set_banking_mode(pattern_table, mode);
-		/* Convert bank number to base address */
-		/* Update pointer to new shift table */
-		shift = *table->shift;
-		for (i = 0; i < 4; ++i) {
-			banks[i] <<= shift[i];
+		set_banking_mode(p3, pattern_table, mode);
+		/* Update pointer to new mask table */
+		mask = *table->mask;
+		for (i = 0; i < 8; ++i) {
+			banks[i] = segments[i & ~(mask[i] >> SEGMENT_SHIFT)] & ~(cadr_t) mask[i];
 		}
 		/* TODO: remove this check */
-		CHECK_LINE(check_table_banks(pattern_table);)
+		CHECK_LINE(check_table_banks(p3, pattern_table);)
 	}
 }
 
-static int get_table_bank(int pattern_table, int bank)
+static int get_table_bank(P3_OBJECT *p3, int pattern_table, int bank)
 {
 	const struct mmc_table_state *table = &S(mmc_tables)[pattern_table];
 	const byte *group = *table->group;
 	int i;
-	for (i = 0; i < 4; ++i) {
+	for (i = 0; i < 8; ++i) {
 		if (group[i] == bank) {
 			/* Convert base address to bank number */
 			return table->banks[i] >> (*table->shift)[i];
@@ -191,7 +226,7 @@ static int get_table_bank(int pattern_table, int bank)
 	return 0;
 }
 
-static void set_table_bank(int pattern_table, int bank, int number)
+static void set_table_bank(P3_OBJECT *p3, int pattern_table, int bank, int number)
 {
 	const struct mmc_table_state *table = &S(mmc_tables)[pattern_table];
 	cadr_t *banks = table->banks;
@@ -199,7 +234,7 @@ static void set_table_bank(int pattern_table, int bank, int number)
 	const byte *shift = *table->shift;
 	int i;
 	BOOL success = FALSE;
-	for (i = 0; i < 4; ++i) {
+	for (i = 0; i < 8; ++i) {
 		if (group[i] == bank) {
 			/* Convert bank number to base address */
 			banks[i] = number << shift[i];
@@ -208,58 +243,43 @@ static void set_table_bank(int pattern_table, int bank, int number)
 	}
 	if (!success)
 		set_last_error("p3_set_bank(): bad 'bank' argument");
-	CHECK_LINE(check_table_banks(pattern_table));
+	CHECK_LINE(check_table_banks(p3, pattern_table));
 }
 
-static void setup_table_banks(int pattern_table, int num_8kb)
+static void setup_table_banks(P3_OBJECT *p3, int pattern_table, int num_8kb)
 {
 	const struct mmc_table_state *table = &S(mmc_tables)[pattern_table];
 	cadr_t *banks = table->banks;
 	const byte *shift = *table->shift;
 	int i;
 	/* Copy initial bank numbers */
-	memcpy(banks, setup_banks_data[table->table][*table->mode], sizeof(cadr_t) * 4);
+	memcpy(banks, setup_banks_data[table->table][*table->mode], sizeof(cadr_t) * 8);
 	/* Shift to next 8 KB bank, if needed */
 	if (num_8kb) {
 		const byte *scale = banking_mode_scale[*table->mode];
-		for (i = 0; i < 4; ++i) {
+		for (i = 0; i < 8; ++i) {
 			banks[i] += (num_8kb * scale[i]);
 		}
 	}
 	/* Convert bank number to base address */
-	for (i = 0; i < 4; ++i) {
+	for (i = 0; i < 8; ++i) {
 		banks[i] <<= shift[i];
 	}
 }
 
-static void reset_table_banks(int pattern_table)
+static void reset_table_banks(P3_OBJECT *p3, int pattern_table)
 {
-	memset(S(mmc_tables)[pattern_table].banks, 0, sizeof(cadr_t) * 4);
+	memset(S(mmc_tables)[pattern_table].banks, 0, sizeof(cadr_t) * 8);
 }
 
-void g_update_mapper_fn(void)
+void g_update_mapper_fn(P3_OBJECT *p3)
 {
-	switch (S(glob_mmc_mode)) {
-	case MMC_MODE_SKIP:
-		S(main_map_func) = skip_mapping;
-		S(bg_map_func) = skip_mapping;
-		S(obj_map_func) = skip_mapping;
-		break;
-
-	case MMC_MODE_BANK_8:
-		S(main_map_func) = map_address_8;
-		S(bg_map_func) = map_address_8;
-		S(obj_map_func) = map_address_8;
-		break;
-
-	case MMC_MODE_TABS:
-		S(main_map_func) = map_address;
-		S(bg_map_func) = map_func_lut[S(bg_pattern_table)];
-		S(obj_map_func) = map_func_lut[S(obj_pattern_table)];
-	}
+	STATE_CHANGED();
+	g_invalidate_bg_plane(p3);
+	update_chr_windows(p3);
 }
 
-static int resolve_pattern_table(int table)
+static int resolve_pattern_table(P3_OBJECT *p3, int table)
 {
 	switch (table) {
 	case P3_CHR_TABLE_BG:
@@ -274,60 +294,92 @@ static int resolve_pattern_table(int table)
 }
 
 /* Mirroring */
-static byte top_left_mirroring(byte page) {	return P3_TOP_LEFT_PAGE; }
-static byte top_right_mirroring(byte page) { return P3_TOP_RIGHT_PAGE; }
-static byte bottom_left_mirroring(byte page) { return P3_BOTTOM_LEFT_PAGE; }
-static byte bottom_right_mirroring(byte page) { return P3_BOTTOM_RIGHT_PAGE; }
-static byte horizontal_mirroring(byte page) { return page >> 1; }
-static byte vertical_mirroring(byte page) { return page & 1; }
-static byte custom_mirroring(byte page) { return S(mirroring_lut)[page]; }
-static byte four_mirroring(byte page) { return page; }
-
-static byte(* const mirroring_func_lut[8])(byte) = {
+static byte top_left_mirroring(P3_OBJECT *p3, byte page) {	return P3_TOP_LEFT_PAGE; }
+static byte top_right_mirroring(P3_OBJECT *p3, byte page) { return P3_TOP_RIGHT_PAGE; }
+static byte bottom_left_mirroring(P3_OBJECT *p3, byte page) { return P3_BOTTOM_LEFT_PAGE; }
+static byte bottom_right_mirroring(P3_OBJECT *p3, byte page) { return P3_BOTTOM_RIGHT_PAGE; }
+static byte horizontal_mirroring(P3_OBJECT *p3, byte page) { return page >> 1; }
+static byte vertical_mirroring(P3_OBJECT *p3, byte page) { return page & 1; }
+static byte custom_mirroring(P3_OBJECT *p3, byte page) { return S(mirroring_lut)[page]; }
+static byte four_mirroring(P3_OBJECT *p3, byte page) { return page; }
+
+static byte(* const mirroring_func_lut[8])(P3_OBJECT *, byte) = {
 	top_left_mirroring, top_right_mirroring,
 	bottom_left_mirroring, bottom_right_mirroring,
 	horizontal_mirroring, vertical_mirroring,
 	custom_mirroring, four_mirroring
 };
 
-void g_initialize_mapper(void)
+void g_initialize_mapper(P3_OBJECT *p3)
 {
-	set_banking_mode(P3_CHR_TABLE_LEFT, P3_MMC_MODE_4X1);
-	set_banking_mode(P3_CHR_TABLE_RIGHT, P3_MMC_MODE_4X1);
-	p3_setup_banks(0);
-	g_update_mapper_fn();
-	p3_set_mirroring_type(P3_MIRRORING_HORIZONTAL);
+	set_banking_mode(p3, P3_CHR_TABLE_LEFT, P3_MMC_MODE_4X1);
+	set_banking_mode(p3, P3_CHR_TABLE_RIGHT, P3_MMC_MODE_4X1);
+	p3x_setup_banks(p3, 0);
+	g_update_mapper_fn(p3);
+	p3x_set_mirroring_type(p3, P3_MIRRORING_HORIZONTAL);
 }
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
-static void late_setup(void)
+static void late_setup(P3_OBJECT *p3)
 {
 	if (S(glob_mmc_mode) != MMC_MODE_TABS) {
 		int num = S(bank_8x1) >> 13;
-		setup_table_banks(P3_CHR_TABLE_LEFT, num);
-		setup_table_banks(P3_CHR_TABLE_RIGHT, num);
+		setup_table_banks(p3, P3_CHR_TABLE_LEFT, num);
+		setup_table_banks(p3, P3_CHR_TABLE_RIGHT, num);
 		S(glob_mmc_mode) = MMC_MODE_TABS;
-		g_update_mapper_fn();
+		g_update_mapper_fn(p3);
 		/* TODO remove */
-		CHECK_LINE(g_check_banks();)
+		CHECK_LINE(g_check_banks(p3);)
+	}
+}
+
+/* P3_CHR_TABLE_PPU selects both pattern tables, its bank addresses are
+   addresses of left table followed by addresses of right table */
+static int resolve_bank_table(P3_OBJECT *p3, int table, int *bank_adr)
+{
+	int count;
+	if (table == P3_CHR_TABLE_PPU) {
+		count = bank_address_counts[S(left_table_mode)];
+		table = P3_CHR_TABLE_LEFT;
+		*bank_adr &= 15;
+		if (*bank_adr >= count) {
+			*bank_adr -= count;
+			table = P3_CHR_TABLE_RIGHT;
+		}
+	} else {
+		table = resolve_pattern_table(p3, table);
 	}
+	count = bank_address_counts[*S(mmc_tables)[table].mode];
+	*bank_adr &= count - 1;
+	return table;
 }
 
-int p3_get_mmc_mode(int table)
+int p3x_get_mmc_mode(P3_OBJECT *p3, int table)
 {
 	if ((table >= P3_CHR_TABLE_LEFT) && (table <= P3_CHR_TABLE_OBJ))
-		return *S(mmc_tables)[resolve_pattern_table(table)].mode;
+		return *S(mmc_tables)[resolve_pattern_table(p3, table)].mode;
+	if (table == P3_CHR_TABLE_PPU) {
+		if (S(left_table_mode) != S(right_table_mode))
+			set_last_error("p3_get_mmc_mode(): pattern tables have different modes");
+		return S(left_table_mode);
+	}
 	set_last_error("p3_get_mmc_mode(): bad 'table' argument");
 	return 0;
 }
 
-void p3_set_mmc_mode(int table, int mode)
+void p3x_set_mmc_mode(P3_OBJECT *p3, int table, int mode)
 {
-	if ((mode >= P3_MMC_MODE_4X1) && (mode <= P3_MMC_MODE_1X4)) {
+	if ((mode >= P3_MMC_MODE_4X1) && (mode <= P3_MMC_MODE_05X8)) {
 		if ((table >= P3_CHR_TABLE_LEFT) && (table <= P3_CHR_TABLE_OBJ)) {
-			late_setup();
-			convert_table_banks(resolve_pattern_table(table), mode);
+			late_setup(p3);
+			convert_table_banks(p3, resolve_pattern_table(p3, table), mode);
+			g_update_mapper_fn(p3);
+		} else if (table == P3_CHR_TABLE_PPU) {
+			late_setup(p3);
+			convert_table_banks(p3, P3_CHR_TABLE_LEFT, mode);
+			convert_table_banks(p3, P3_CHR_TABLE_RIGHT, mode);
+			g_update_mapper_fn(p3);
 		} else {
 			set_last_error("p3_set_mmc_mode(): bad 'table' argument");
 		}
@@ -336,47 +388,55 @@ void p3_set_mmc_mode(int table, int mode)
 	}
 }
 
-int p3_get_bank(int table, int bank_adr)
+int p3x_get_bank(P3_OBJECT *p3, int table, int bank_adr)
 {
-	if ((table >= P3_CHR_TABLE_LEFT) && (table <= P3_CHR_TABLE_OBJ)) {
-		late_setup();
-		return get_table_bank(resolve_pattern_table(table), bank_adr & 3);
+	if ((table >= P3_CHR_TABLE_LEFT) && (table <= P3_CHR_TABLE_PPU)) {
+		late_setup(p3);
+		table = resolve_bank_table(p3, table, &bank_adr);
+		return get_table_bank(p3, table, bank_adr);
 	}
 	set_last_error("p3_get_bank(): bad 'table' argument");
 	return 0;
 }
 
-void p3_set_bank(int table, int bank_adr, int num)
+void p3x_set_bank(P3_OBJECT *p3, int table, int bank_adr, int num)
 {
-	if ((table >= P3_CHR_TABLE_LEFT) && (table <= P3_CHR_TABLE_OBJ)) {
-		late_setup();
-		set_table_bank(resolve_pattern_table(table), bank_adr & 3, num);
+	if ((table >= P3_CHR_TABLE_LEFT) && (table <= P3_CHR_TABLE_PPU)) {
+		late_setup(p3);
+		table = resolve_bank_table(p3, table, &bank_adr);
+		set_table_bank(p3, table, bank_adr, num);
+		g_update_mapper_fn(p3);
 	} else {
 		set_last_error("p3_set_bank(): bad 'table' argument");
 	}
 }
 
-void p3_reset_table_banks(int table)
+void p3x_reset_table_banks(P3_OBJECT *p3, int table)
 {
 	if ((table >= P3_CHR_TABLE_LEFT) && (table <= P3_CHR_TABLE_OBJ)) {
-		late_setup();
-		reset_table_banks(resolve_pattern_table(table));
+		late_setup(p3);
+		reset_table_banks(p3, resolve_pattern_table(p3, table));
+		g_update_mapper_fn(p3);
+	} else if (table == P3_CHR_TABLE_PPU) {
+		late_setup(p3);
+		reset_table_banks(p3, P3_CHR_TABLE_LEFT);
+		reset_table_banks(p3, P3_CHR_TABLE_RIGHT);
+		g_update_mapper_fn(p3);
 	} else {
 		set_last_error("p3_reset_table_banks(): bad 'table' argument");
 	}
 }
 
-void p3_reset_banks(void)
+void p3x_reset_banks(P3_OBJECT *p3)
 {
-	p3_reset_table_banks(P3_CHR_TABLE_LEFT);
-	p3_reset_table_banks(P3_CHR_TABLE_RIGHT);
+	p3x_reset_table_banks(p3, P3_CHR_TABLE_LEFT);
+	p3x_reset_table_banks(p3, P3_CHR_TABLE_RIGHT);
 }
 
-void p3_setup_banks(int bank8k)
+void p3x_setup_banks(P3_OBJECT *p3, int bank8k)
 {
-	if (((unsigned) bank8k) < 128) {		
+	if (((unsigned) bank8k) < (unsigned) (S(tileset_size) >> 13)) {
 		int newmode = MMC_MODE_BANK_8;
-		bank8k &= 0x7f;
 		if (!bank8k) {
 			newmode = MMC_MODE_SKIP;
 			S(bank_8x1) = 0;
@@ -384,32 +444,59 @@ void p3_setup_banks(int bank8k)
 			/* Convert bank number to base address */
 			S(bank_8x1) = bank8k << 13;
 		}
-		if (newmode != S(glob_mmc_mode)) {
-			S(glob_mmc_mode) = newmode;
-			g_update_mapper_fn();
-		}
-		CHECK_LINE(g_check_banks();)
+		S(glob_mmc_mode) = newmode;
+		g_update_mapper_fn(p3);
+		CHECK_LINE(g_check_banks(p3);)
 	} else {
 		set_last_error("p3_setup_banks(): 'bank8k' out of range");
 	}
 }
 
-int p3_get_last_banks_setup(void) { return S(bank_8x1) >> 13; }
-int p3_map_address(int address) { return S(main_map_func)(address & 0x1fff); }
-int p3_map_tile(int index) { return S(main_map_func)((index & 0x1ff) << 4) >> 4; }
-int p3_get_mirroring_type(void) { return S(mirroring_type); }
+int p3x_get_last_banks_setup(P3_OBJECT *p3) { return S(bank_8x1) >> 13; }
+/* Tileset address, not offset in resident banks of paged tileset */
+static cadr_t map_chr_bank(P3_OBJECT *p3, padr_t address)
+{
+	return S(chr_banks)[(address >> SEGMENT_SHIFT) & 15] | (address & 0x1ff);
+}
+
+/* Tileset index of tile of pattern tables, returns number of tiles from
+   it to end of its window, they follow it in tileset */
+int g_map_tile_run(P3_OBJECT *p3, int index, int *tile)
+{
+	padr_t address = (padr_t) ((index & 0x1ff) << 4);
+	*tile = (int) (map_chr_bank(p3, address) >> 4);
+	return ((1 << SEGMENT_SHIFT) - (address & ((1 << SEGMENT_SHIFT) - 1))) >> 4;
+}
+
+int p3x_map_address(P3_OBJECT *p3, int address) { return map_chr_bank(p3, address & 0x1fff); }
+int p3x_map_tile(P3_OBJECT *p3, int index) { return map_chr_bank(p3, (index & 0x1ff) << 4) >> 4; }
+int p3x_get_mirroring_type(P3_OBJECT *p3) { return S(mirroring_type); }
 
-void p3_set_mirroring_type(int type)
+/* Mirroring functions are used only to rebuild page bases, fetch of
+   nametable byte takes base of its page */
+static void update_page_bases(P3_OBJECT *p3)
+{
+	byte (*mirror)(P3_OBJECT *, byte) = mirroring_func_lut[S(mirroring_type)];
+	byte page;
+
+	for (page = 0; page < 4; ++page) {
+		S(page_bases)[page] = (padr_t) mirror(p3, page) << 10;
+	}
+}
+
+void p3x_set_mirroring_type(P3_OBJECT *p3, int type)
 {
 	if ((type >= P3_MIRRORING_TOP_LEFT) && (type <= P3_MIRRORING_NONE)) {
 		S(mirroring_type) = type;
-		S(mirroring_function) = mirroring_func_lut[S(mirroring_type)];
+		update_page_bases(p3);
+		STATE_CHANGED();
+		g_invalidate_bg_plane(p3);
 	} else {
 		set_last_error("p3_set_mirroring_type(): bad 'type' argument");
 	}
 }
 
-void p3_get_mirroring_lut(int lut[4])
+void p3x_get_mirroring_lut(P3_OBJECT *p3, int lut[4])
 {
 	if (lut) {
 		lut[0] = S(mirroring_lut)[0];
@@ -421,136 +508,29 @@ void p3_get_mirroring_lut(int lut[4])
 	}
 }
 
-void p3_set_mirroring_lut(const int lut[4])
+void p3x_set_mirroring_lut(P3_OBJECT *p3, const int lut[4])
 {
 	if (lut) {
 		S(mirroring_lut)[0] = lut[0] & 3;
 		S(mirroring_lut)[1] = lut[1] & 3;
 		S(mirroring_lut)[2] = lut[2] & 3;
 		S(mirroring_lut)[3] = lut[3] & 3;
+		update_page_bases(p3);
+		STATE_CHANGED();
+		g_invalidate_bg_plane(p3);
 	} else {
 		set_last_error("p3_set_mirroring_lut(): bad 'lut' argument");
 	}
 }
 
-void p3_set_mirroring_lut_4(int tl, int tr, int bl, int br)
+void p3x_set_mirroring_lut_4(P3_OBJECT *p3, int tl, int tr, int bl, int br)
 {
 	int lut[4] = { tl, tr, bl, br };
-	p3_set_mirroring_lut(lut);
+	p3x_set_mirroring_lut(p3, lut);
 }
 
-int p3_mirror_page(int page)
+int p3x_mirror_page(P3_OBJECT *p3, int page)
 {
 	page &= 3;
-	return S(mirroring_function)(page);
-}
-
-/* * * * * * * * * * * * * * Bank-number converter * * * * * * * * * * * * * */
-
-/* Conversion command */
-#define SKIP         0
-#define MUL2         9
-#define MUL4         10
-#define MUL8         11
-#define DIV2         5
-#define DIV4         6
-#define DIV8         7
-#define CPYB         1
-
-/* Increment, add to result bank number */
-#define ADD1         1
-#define ADD2         2
-#define ADD3         3
-
-/* Argument for CPYB command */
-#define BAN0         0
-#define BAN1         1
-#define BAN2         2
-#define BAN3         3
-
-/* Used to convert bank numbers between different banking modes */
-struct conversion_data_item {
-	byte cmd : 6;           /* Command to execute */
-	byte num : 2;           /* Increment or argument for CPYB */
-};
-
-/* Conversion data for all combinations of banking modes */
-static const struct conversion_data_item conversion_data[5][5][4] = {
-	{ /* P3_MMC_MODE_4X1 -> P3_MMC_MODE_4X1 */
-		{{SKIP}, {SKIP}, {SKIP}, {SKIP}},
-		/* P3_MMC_MODE_4X1 -> P3_MMC_MODE_2X2 */
-		{{MUL2}, {MUL2}, {MUL2, ADD1}, {MUL2, ADD1}},
-		/* P3_MMC_MODE_4X1 -> P3_MMC_MODE_211 */
-		{{MUL2}, {MUL2}, {MUL4, ADD2}, {MUL4, ADD3}},
-		/* P3_MMC_MODE_4X1 -> P3_MMC_MODE_112 */
-		{{MUL4}, {MUL4, ADD1}, {MUL2, ADD1}, {MUL2, ADD1}},
-		/* P3_MMC_MODE_4X1 -> P3_MMC_MODE_1X4 */
-		{{MUL4}, {MUL4, ADD1}, {MUL4, ADD2}, {MUL4, ADD3}},
-	},
-	{ /* P3_MMC_MODE_2X2 -> P3_MMC_MODE_4X1 */
-		{{DIV2}, {CPYB, BAN0}, {CPYB, BAN0}, {CPYB, BAN0}},
-		/* P3_MMC_MODE_2X2 -> P3_MMC_MODE_2X2 */
-		{{SKIP}, {SKIP}, {SKIP}, {SKIP}},
-		/* P3_MMC_MODE_2X2 -> P3_MMC_MODE_211 */
-		{{SKIP}, {SKIP}, {MUL2}, {MUL2, ADD1}},
-		/* P3_MMC_MODE_2X2 -> P3_MMC_MODE_112 */
-		{{MUL2}, {MUL2, ADD1}, {SKIP}, {SKIP}},
-		/* P3_MMC_MODE_2X2 -> P3_MMC_MODE_1X4 */
-		{{MUL2}, {MUL2, ADD1}, {MUL2}, {MUL2, ADD1}},
-	},
-	{ /* P3_MMC_MODE_211 -> P3_MMC_MODE_4X1 */
-		{{DIV2}, {CPYB, BAN0}, {CPYB, BAN0}, {CPYB, BAN0}},
-		/* P3_MMC_MODE_211 -> P3_MMC_MODE_2X2 */
-		{{SKIP}, {SKIP}, {DIV2}, {CPYB, BAN2}},
-		/* P3_MMC_MODE_211 -> P3_MMC_MODE_211 */
-		{{SKIP}, {SKIP}, {SKIP}, {SKIP}},
-		/* P3_MMC_MODE_211 -> P3_MMC_MODE_112 */
-		{{MUL2}, {MUL2, ADD1}, {DIV2}, {CPYB, BAN2}},
-		/* P3_MMC_MODE_211 -> P3_MMC_MODE_1X4 */
-		{{MUL2}, {MUL2, ADD1}, {SKIP}, {SKIP}},
-	},
-	{ /* P3_MMC_MODE_112 -> P3_MMC_MODE_4X1 */
-		{{DIV4}, {CPYB, BAN0}, {CPYB, BAN0}, {CPYB, BAN0}},
-		/* P3_MMC_MODE_112 -> P3_MMC_MODE_2X2 */
-		{{DIV2}, {CPYB, BAN0}, {SKIP}, {SKIP}},
-		/* P3_MMC_MODE_112 -> P3_MMC_MODE_211 */
-		{{DIV2}, {CPYB, BAN0}, {MUL2}, {MUL2, ADD1}},
-		/* P3_MMC_MODE_112 -> P3_MMC_MODE_112 */
-		{{SKIP}, {SKIP}, {SKIP}, {SKIP}},
-		/* P3_MMC_MODE_112 -> P3_MMC_MODE_1X4 */
-		{{SKIP}, {SKIP}, {MUL2}, {MUL2, ADD1}},
-	},
-	{ /* P3_MMC_MODE_1X4 -> P3_MMC_MODE_4X1 */
-		{{DIV4}, {CPYB, BAN0}, {CPYB, BAN0}, {CPYB, BAN0}},
-		/* P3_MMC_MODE_1X4 -> P3_MMC_MODE_2X2 */
-		{{DIV2}, {CPYB, BAN0}, {DIV2}, {CPYB, BAN2}},
-		/* P3_MMC_MODE_1X4 -> P3_MMC_MODE_211 */
-		{{DIV2}, {CPYB, BAN0}, {SKIP}, {SKIP}},
-		/* P3_MMC_MODE_1X4 -> P3_MMC_MODE_112 */
-		{{SKIP}, {SKIP}, {DIV2}, {CPYB, BAN2}},
-		/* P3_MMC_MODE_1X4 -> P3_MMC_MODE_1X4 */
-		{{SKIP}, {SKIP}, {SKIP}, {SKIP}},
-	}
-};
-
-static void convert_banks(int from, int to, cadr_t *banks)
-{
-	const struct conversion_data_item *conv = conversion_data[from][to];
-	int i;
-	for (i = 0; i < 4; ++i) {
-		byte cmd = conv[i].cmd;
-		if (!cmd) {
-			/* Skipping */
-			continue;
-		} else if (cmd & 8) {
-			/* Multiplication */
-			banks[i] = (banks[i] << (cmd & 3)) + conv[i].num;
-		} else if (cmd & 4) {
-			/* Division */
-			banks[i] = (banks[i] >> (cmd & 3)) + conv[i].num;
-		} else {
-			/* Copying */
-			banks[i] = banks[conv[i].num];
-		}
-	}
+	return S(page_bases)[page] >> 10;
 }
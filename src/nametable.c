@@ -21,17 +21,22 @@
 #include "p3.h"
 #include "common.h"
 
-void p3_fill_nametable(int page, int tile)
+/* bg_plane.c module */
+void g_invalidate_bg_plane(P3_OBJECT *obj);
+
+void p3x_fill_nametable(P3_OBJECT *p3, int page, int tile)
 {
 	page &= 3;
 	tile &= 0xff;
-	p3_set_address(page * 1024);
-	memset(p3_get_v_pointer(), tile, 960);
+	p3x_set_address(p3, page * 1024);
+	memset(p3x_get_v_pointer(p3), tile, 960);
+	STATE_CHANGED();
+	g_invalidate_bg_plane(p3);
 }
 
-void p3_zero_nametable(int page) { p3_fill_nametable(page, 0x00); }
+void p3x_zero_nametable(P3_OBJECT *p3, int page) { p3x_fill_nametable(p3, page, 0x00); }
 
-void p3_fill_nametable_row_2(int page, int row, int tile, int start, int end)
+void p3x_fill_nametable_row_2(P3_OBJECT *p3, int page, int row, int tile, int start, int end)
 {
 	page &= 3;
 	row &= 0x1f;
@@ -44,14 +49,14 @@ void p3_fill_nametable_row_2(int page, int row, int tile, int start, int end)
 		start = end;
 		end = start;
 	}
-	p3_set_increment(P3_INCREMENT_HORIZONTAL);
-	p3_set_address(p3_make_name_address_2t(page, start, row));
-	p3_fill(tile, end - start + 1);
+	p3x_set_increment(p3, P3_INCREMENT_HORIZONTAL);
+	p3x_set_address(p3, p3_make_name_address_2t(page, start, row));
+	p3x_fill(p3, tile, end - start + 1);
 }
 
-void p3_fill_nametable_row(int page, int row, int tile) { p3_fill_nametable_row_2(page, row, tile, 0, 31); }
+void p3x_fill_nametable_row(P3_OBJECT *p3, int page, int row, int tile) { p3x_fill_nametable_row_2(p3, page, row, tile, 0, 31); }
 
-void p3_fill_nametable_column_2(int page, int col, int tile, int start, int end)
+void p3x_fill_nametable_column_2(P3_OBJECT *p3, int page, int col, int tile, int start, int end)
 {
 	page &= 3;
 	col &= 0x1f;
@@ -65,30 +70,32 @@ void p3_fill_nametable_column_2(int page, int col, int tile, int start, int end)
 		start = end;
 		end = start;
 	}
-	p3_set_increment(P3_INCREMENT_VERTICAL);
-	p3_set_address(p3_make_name_address_2t(page, col, start));
-	p3_fill(tile, end - start + 1);
+	p3x_set_increment(p3, P3_INCREMENT_VERTICAL);
+	p3x_set_address(p3, p3_make_name_address_2t(page, col, start));
+	p3x_fill(p3, tile, end - start + 1);
 }
 
-void p3_fill_nametable_column(int page, int col, int tile) { p3_fill_nametable_column_2(page, col, tile, 0, 29); }
+void p3x_fill_nametable_column(P3_OBJECT *p3, int page, int col, int tile) { p3x_fill_nametable_column_2(p3, page, col, tile, 0, 29); }
 
-void p3_read_nametable(int page, void *buf)
+void p3x_read_nametable(P3_OBJECT *p3, int page, void *buf)
 {
 	if (buf) {
 		page &= 3;
-		p3_set_address(page * 1024);
-		memcpy(buf, p3_get_v_pointer(), 960);
+		p3x_set_address(p3, page * 1024);
+		memcpy(buf, p3x_get_v_pointer(p3), 960);
 	} else {
 		set_last_error("p3_read_nametable(): bad 'buf' argument");
 	}
 }
 
-void p3_write_nametable(int page, const void *data)
+void p3x_write_nametable(P3_OBJECT *p3, int page, const void *data)
 {
 	if (data) {
 		page &= 3;
-		p3_set_address(page * 1024);
-		memcpy(p3_get_v_pointer(), data, 960);
+		p3x_set_address(p3, page * 1024);
+		memcpy(p3x_get_v_pointer(p3), data, 960);
+		STATE_CHANGED();
+		g_invalidate_bg_plane(p3);
 	} else {
 		set_last_error("p3_write_nametable(): bad 'data' argument");
 	}
@@ -129,11 +136,11 @@ int p3_make_name_address_2t(int page, int x, int y)
 	return (page << 10) | (y << 5) | x;
 }
 
-int p3_get_name(int index) { return p3_get_byte_at(p3_make_name_address(index)); }
-void p3_put_name(int index, int tile) { p3_put_byte_at(p3_make_name_address(index), tile); }
-int p3_get_name_1t(int page, int index) { return p3_get_byte_at(p3_make_name_address_1t(page, index)); }
-void p3_put_name_1t(int page, int index, int tile) { p3_put_byte_at(p3_make_name_address_1t(page, index), tile); }
-int p3_get_name_2(int x, int y) { return p3_get_byte_at(p3_make_name_address_2(x, y)); }
-void p3_put_name_2(int x, int y, int tile){ p3_put_byte_at(p3_make_name_address_2(x, y), tile); }
-int p3_get_name_2t(int page, int x, int y) { return p3_get_byte_at(p3_make_name_address_2t(page, x, y)); }
-void p3_put_name_2t(int page, int x, int y, int tile){ p3_put_byte_at(p3_make_name_address_2t(page, x, y), tile); }
+int p3x_get_name(P3_OBJECT *p3, int index) { return p3x_get_byte_at(p3, p3_make_name_address(index)); }
+void p3x_put_name(P3_OBJECT *p3, int index, int tile) { p3x_put_byte_at(p3, p3_make_name_address(index), tile); }
+int p3x_get_name_1t(P3_OBJECT *p3, int page, int index) { return p3x_get_byte_at(p3, p3_make_name_address_1t(page, index)); }
+void p3x_put_name_1t(P3_OBJECT *p3, int page, int index, int tile) { p3x_put_byte_at(p3, p3_make_name_address_1t(page, index), tile); }
+int p3x_get_name_2(P3_OBJECT *p3, int x, int y) { return p3x_get_byte_at(p3, p3_make_name_address_2(x, y)); }
+void p3x_put_name_2(P3_OBJECT *p3, int x, int y, int tile){ p3x_put_byte_at(p3, p3_make_name_address_2(x, y), tile); }
+int p3x_get_name_2t(P3_OBJECT *p3, int page, int x, int y) { return p3x_get_byte_at(p3, p3_make_name_address_2t(page, x, y)); }
+void p3x_put_name_2t(P3_OBJECT *p3, int page, int x, int y, int tile){ p3x_put_byte_at(p3, p3_make_name_address_2t(page, x, y), tile); }
@@ -24,34 +24,67 @@
 DEFINE_P3_OBJECT;
 
 /* tileset.c module */
-BOOL g_initialize_tileset(void *chr, int chr_size);
+BOOL g_initialize_tileset(P3_OBJECT *p3, void *chr, int chr_size);
+
+/* compositor.c module */
+void g_initialize_compositor(void);
+void g_setup_compose_state(struct compose_state *cs, const byte *palette, uint16_t tint,
+                           byte grayscale, BOOL show_bg, BOOL show_obj, BOOL clip_bg, BOOL clip_obj);
+void g_compose_line(uint16_t *dst, const byte *bg, const byte *obj, const struct compose_state *cs);
+void g_build_rgb_lut(uint32_t *lut, int format, const unsigned int *palette);
+void g_convert_line(void *dst, const uint16_t *src, int format, const uint32_t *lut);
 
 /* mapper.c module */
-void g_initialize_mapper(void);
-void g_update_mapper_fn(void);
-byte *g_get_tile(padr_t);
-byte *g_get_bg_tile(padr_t);
-byte *g_get_obj_tile(padr_t);
-
-/* Map byte 76543210 to 01234567 */
-static const byte byte_reverse_lut[256] = {
-	0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0,
-	0x08, 0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8, 0x18, 0x98, 0x58, 0xD8, 0x38, 0xB8, 0x78, 0xF8,
-	0x04, 0x84, 0x44, 0xC4, 0x24, 0xA4, 0x64, 0xE4, 0x14, 0x94, 0x54, 0xD4, 0x34, 0xB4, 0x74, 0xF4,
-	0x0C, 0x8C, 0x4C, 0xCC, 0x2C, 0xAC, 0x6C, 0xEC, 0x1C, 0x9C, 0x5C, 0xDC, 0x3C, 0xBC, 0x7C, 0xFC,
-	0x02, 0x82, 0x42, 0xC2, 0x22, 0xA2, 0x62, 0xE2, 0x12, 0x92, 0x52, 0xD2, 0x32, 0xB2, 0x72, 0xF2,
-	0x0A, 0x8A, 0x4A, 0xCA, 0x2A, 0xAA, 0x6A, 0xEA, 0x1A, 0x9A, 0x5A, 0xDA, 0x3A, 0xBA, 0x7A, 0xFA,
-	0x06, 0x86, 0x46, 0xC6, 0x26, 0xA6, 0x66, 0xE6, 0x16, 0x96, 0x56, 0xD6, 0x36, 0xB6, 0x76, 0xF6,
-	0x0E, 0x8E, 0x4E, 0xCE, 0x2E, 0xAE, 0x6E, 0xEE, 0x1E, 0x9E, 0x5E, 0xDE, 0x3E, 0xBE, 0x7E, 0xFE,
-	0x01, 0x81, 0x41, 0xC1, 0x21, 0xA1, 0x61, 0xE1, 0x11, 0x91, 0x51, 0xD1, 0x31, 0xB1, 0x71, 0xF1,
-	0x09, 0x89, 0x49, 0xC9, 0x29, 0xA9, 0x69, 0xE9, 0x19, 0x99, 0x59, 0xD9, 0x39, 0xB9, 0x79, 0xF9,
-	0x05, 0x85, 0x45, 0xC5, 0x25, 0xA5, 0x65, 0xE5, 0x15, 0x95, 0x55, 0xD5, 0x35, 0xB5, 0x75, 0xF5,
-	0x0D, 0x8D, 0x4D, 0xCD, 0x2D, 0xAD, 0x6D, 0xED, 0x1D, 0x9D, 0x5D, 0xDD, 0x3D, 0xBD, 0x7D, 0xFD,
-	0x03, 0x83, 0x43, 0xC3, 0x23, 0xA3, 0x63, 0xE3, 0x13, 0x93, 0x53, 0xD3, 0x33, 0xB3, 0x73, 0xF3,
-	0x0B, 0x8B, 0x4B, 0xCB, 0x2B, 0xAB, 0x6B, 0xEB, 0x1B, 0x9B, 0x5B, 0xDB, 0x3B, 0xBB, 0x7B, 0xFB,
-	0x07, 0x87, 0x47, 0xC7, 0x27, 0xA7, 0x67, 0xE7, 0x17, 0x97, 0x57, 0xD7, 0x37, 0xB7, 0x77, 0xF7,
-	0x0F, 0x8F, 0x4F, 0xCF, 0x2F, 0xAF, 0x6F, 0xEF, 0x1F, 0x9F, 0x5F, 0xDF, 0x3F, 0xBF, 0x7F, 0xFF
-};
+void g_initialize_mapper(P3_OBJECT *p3);
+void g_update_mapper_fn(P3_OBJECT *p3);
+
+/* tile_cache.c module */
+void g_decode_tile_row(byte *dst, byte lo, byte hi, BOOL flip);
+void g_decode_cached_tile(P3_OBJECT *obj, cadr_t tile);
+BOOL g_prepare_tile_cache(P3_OBJECT *p3);
+void g_fill_tile_cache(P3_OBJECT *obj);
+void g_release_tile_cache(P3_OBJECT *obj);
+
+/* tile_dirty.c module */
+void g_release_dirty_tiles(P3_OBJECT *obj);
+void g_copy_dirty_tiles(P3_OBJECT *dst);
+
+/* thread.c module */
+long g_atomic_increment(volatile long *value);
+
+/* batch.c module */
+BOOL g_run_render_pool(void (*job)(void *, long), void *context, long num);
+
+/* bank_pager.c module */
+void g_start_pager_frame(P3_OBJECT *p3);
+void g_release_pager(P3_OBJECT *obj);
+void g_copy_pager(P3_OBJECT *dst);
+
+/* bg_plane.c module */
+BOOL g_prepare_bg_plane(P3_OBJECT *p3);
+void g_fill_bg_plane(P3_OBJECT *obj);
+void g_read_bg_plane_line(P3_OBJECT *obj, byte *dst, int cell_x, int y);
+void g_invalidate_bg_plane(P3_OBJECT *obj);
+void g_invalidate_bg_plane_byte(P3_OBJECT *obj, padr_t address);
+void g_release_bg_plane(P3_OBJECT *obj);
+
+/* chr_file.c module */
+void g_release_chr_file(P3_OBJECT *obj);
+void g_copy_chr_file(P3_OBJECT *dst);
+
+/* ext_attribute.c module */
+void g_release_ext_attributes(P3_OBJECT *obj);
+void g_copy_ext_attributes(P3_OBJECT *dst);
+
+/* frame_change.c module */
+void g_reset_changes(P3_OBJECT *obj);
+void g_commit_line(P3_OBJECT *obj, int row, const uint16_t *line, uint16_t *dst);
+
+/* raster_event.c module */
+void g_start_frame_events(P3_OBJECT *p3);
+void g_schedule_event(P3_OBJECT *p3, int x, int y, P3_CALLBACK proc, void *param, BOOL legacy);
+void g_release_events(P3_OBJECT *obj);
+void g_copy_events(P3_OBJECT *dst, const P3_OBJECT *src);
 
 /* Internal flag for p3_reset() */
 #define P3_RESET_BUFS (1 << 9)
@@ -66,7 +99,7 @@ static void default_callback(int x, int y, void *param) {}
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
-static forceinline void move_to_next_tile(void)
+static forceinline void move_to_next_tile(P3_OBJECT *p3)
 {
 	/* Wrap horizontally */
 	if (S(vcx) == 31) {
@@ -78,7 +111,7 @@ static forceinline void move_to_next_tile(void)
 	}
 }
 
-static forceinline void move_to_next_row(void)
+static forceinline void move_to_next_row(P3_OBJECT *p3)
 {
 	if (S(vfy) < 7) {
 		++S(vfy);
@@ -99,261 +132,542 @@ static forceinline void move_to_next_row(void)
 	}
 }
 
-static forceinline void increment_v_register(void)
+static forceinline void increment_v_register(P3_OBJECT *p3)
 {
 	if (S(increment_size)) {
-		p3_set_address((p3_get_address() + S(increment_size)) & 0x0FFF);
+		p3x_set_address(p3, (p3x_get_address(p3) + S(increment_size)) & 0x0FFF);
 	}
 }
 
-static forceinline padr_t make_current_address(void)
+static forceinline padr_t make_current_address(P3_OBJECT *p3)
 {
-	return ((padr_t) S(mirroring_function)(S(vpg)) << 10) |
-		(S(vcy) << 5) | S(vcx);
+	return S(page_bases)[S(vpg)] | (S(vcy) << 5) | S(vcx);
 }
 
-static forceinline byte get_nametable_byte(void)
+static forceinline byte get_nametable_byte(P3_OBJECT *p3)
 {
-	return S(page_memory)[((padr_t) S(mirroring_function)(S(vpg)) << 10) |
-		(S(vcy) << 5) | S(vcx)];
+	return S(page_memory)[S(page_bases)[S(vpg)] | (S(vcy) << 5) | S(vcx)];
 }
 
-static forceinline byte get_attribute_byte(void)
+static forceinline byte get_attribute_byte(P3_OBJECT *p3)
 {
-	return S(page_memory)[((padr_t) S(mirroring_function)(S(vpg)) << 10) |
+	return S(page_memory)[S(page_bases)[S(vpg)] |
 	                960 | ((S(vcx) >> 2) | (S(vcy) & 0x1c) << 1)];
 }
 
-static void init_sprite_unit(int i, byte chr_lo, byte chr_hi, const P3_SPRITE *sprite)
+/* * * * * * * * * * * * * * * Scanline renderer * * * * * * * * * * * * * * */
+
+/* Same walk as move_to_next_tile() on v register copy of render context */
+static forceinline void next_tile(struct render_context *rc)
+{
+	if (rc->vcx == 31) {
+		rc->vcx = 0;
+		rc->vpg ^= 1;
+	} else {
+		++rc->vcx;
+	}
+}
+
+/* Same walk as move_to_next_row() on v register copy of render context */
+static forceinline void next_row(struct render_context *rc)
+{
+	if (rc->vfy < 7) {
+		++rc->vfy;
+	} else {
+		rc->vfy = 0;
+		if (rc->vcy == 29) {
+			rc->vcy = 0;
+			rc->vpg ^= 2;
+		} else if (rc->vcy == 31) {
+			rc->vcy = 0;
+		} else {
+			++rc->vcy;
+		}
+	}
+}
+
+/* Set v register for scanline, frame starts with v = t */
+static void seek_scanline(struct render_context *rc, int row)
+{
+	unsigned int rows = rc->tfy + row;
+	unsigned int coarse = rows >> 3;
+	unsigned int y = rc->tcy;
+
+	rc->vpg = rc->tpg;
+	rc->vcx = rc->tcx;
+	rc->vfx = rc->tfx;
+	rc->vfy = rows & 7;
+
+	/* Rows 30 and 31 wrap to 0 without nametable switch */
+	if (y >= 30) {
+		if (coarse < 32 - y) {
+			rc->vcy = y + coarse;
+			return;
+		}
+		coarse -= 32 - y;
+		y = 0;
+	}
+	/* Each wrap from row 29 switches vertical nametable */
+	if (((y + coarse) / 30) & 1) {
+		rc->vpg ^= 2;
+	}
+	rc->vcy = (y + coarse) % 30;
+}
+
+/* Get decoded row of tile, address is mapped tileset offset of row */
+static forceinline const byte *get_cached_row(P3_OBJECT *p, cadr_t address, BOOL flip)
+{
+	cadr_t tile = address >> 4;
+	if (!p->tile_cache_valid[tile]) {
+		g_decode_cached_tile(p, tile);
+	}
+	return p->tile_cache + (tile << 7) + (flip ? 64 : 0) + ((address & 7) << 3);
+}
+
+static void init_sprite_unit(P3_OBJECT *p, struct render_context *rc, int i,
+                             cadr_t address, const P3_SPRITE *sprite)
 {
-	struct sprite_unit unit;
-	unit.attribute = sprite->palette << 2;
-	/* Horizontal flipping (reversed, see overlay_sprite_unit) */
-	if (sprite->flip_horizontal) {
-		unit.chr_lo = chr_lo;
-		unit.chr_hi = chr_hi;
+	struct sprite_unit *unit = &rc->sprite_units[i];
+	unit->attribute = sprite->palette << 2;
+	/* Horizontal flipping */
+	if (p->tile_cache) {
+		memcpy(unit->pixels, get_cached_row(p, address, sprite->flip_horizontal), 8);
 	} else {
-		unit.chr_lo = byte_reverse_lut[chr_lo];
-		unit.chr_hi = byte_reverse_lut[chr_hi];
+		const byte *tile = p->tileset_pointer + address;
+		g_decode_tile_row(unit->pixels, *tile, *(tile + 8), sprite->flip_horizontal);
 	}
-	unit.priority = sprite->priority ? 0 : 0x80;
-	unit.x = sprite->x;
-	S(sprite_units)[i] = unit;
+	unit->priority = sprite->priority ? 0 : 0x80;
+	unit->x = sprite->x;
 }
 
-static void overlay_sprite_unit(int i)
+static void overlay_sprite_unit(struct render_context *rc, int i)
 {
 	/* Destination memory */
-	struct sprite_unit unit = S(sprite_units)[i];
-	byte *dst = S(sprite_buffer) + unit.x;
+	const struct sprite_unit *unit = &rc->sprite_units[i];
+	byte *dst = rc->sprite_buffer + unit->x;
+	byte attribute = unit->priority | 16 | unit->attribute;
 	unsigned int j;
 
 	/* Clip row length if sprite cross right screen border */
 	unsigned int write_amount = 8;
-	if (unit.x > (SCREEN_WIDTH - 8)) {
-		write_amount = SCREEN_WIDTH - unit.x;
+	if (unit->x > (SCREEN_WIDTH - 8)) {
+		write_amount = SCREEN_WIDTH - unit->x;
 	}
 
 	/* Render to buffer */
-	for (j = 0; j < write_amount; ++j, ++dst) {
+	for (j = 0; j < write_amount; ++j) {
 		/* Write if destination pixel transparent */
-		if (!((*dst) & 3)) {
-			*dst = unit.priority | 16 | unit.attribute | (unit.chr_lo & 1) | ((
-			                        unit.chr_hi & 1) << 1);
+		if (!(dst[j] & 3)) {
+			dst[j] = attribute | unit->pixels[j];
 		}
-		unit.chr_lo >>= 1;
-		unit.chr_hi >>= 1;
 	}
 }
 
 
-static void evaluate_sprites(void)
+/* Mark scanlines of sprite, obj_mode and fix_obj_y must be same as in rebuild */
+static void mark_sprite_rows(P3_OBJECT *p, const P3_SPRITE *sprite)
 {
-	unsigned int range;         /* note: must be unsigned */
+	byte sprite_y = sprite->y;
+	int last;
+
+	++p->generation;
+	if (p->fix_obj_y) {
+		--sprite_y;
+	}
+	last = sprite_y + p->obj_mode - 1;
+	if (sprite_y < SCREEN_HEIGHT) {
+		if (sprite_y < p->obj_dirty_first) {
+			p->obj_dirty_first = sprite_y;
+		}
+		if (last > p->obj_dirty_last) {
+			p->obj_dirty_last = last < SCREEN_HEIGHT ? last : SCREEN_HEIGHT - 1;
+		}
+	}
+}
+
+static void mark_all_sprite_rows(P3_OBJECT *p)
+{
+	++p->generation;
+	p->obj_dirty_first = 0;
+	p->obj_dirty_last = SCREEN_HEIGHT - 1;
+}
+
+/* Rebuild dirty scanlines in one pass over sprites, sprite order is priority order */
+static void rebuild_sprite_buckets(P3_OBJECT *p)
+{
+	int first = p->obj_dirty_first;
+	int last = p->obj_dirty_last;
 	sprite_index_t sprite_index;
+	int row, top, bottom;
 	byte sprite_y;
-	P3_SPRITE *sprite;
-	byte *tile = NULL;
 
-	S(sprite_count) = 0;
+	memset(p->obj_bucket_count + first, 0, last - first + 1);
+	memset(p->obj_bucket_overflow + first, FALSE, (last - first + 1) * sizeof(BOOL));
 	for (sprite_index = 0; sprite_index < OBJ_MAX; ++sprite_index) {
-		sprite_y = S(obj_memory)[sprite_index].y;
-		if (S(fix_obj_y)) {
+		sprite_y = p->obj_memory[sprite_index].y;
+		if (p->fix_obj_y) {
 			--sprite_y;
 		}
-		range = S(frame_row) - sprite_y;
-		/* If sprite on current scanline ? */
-		if (range < S(obj_mode)) {
-			sprite = &S(obj_memory)[sprite_index];
-			switch (S(obj_mode)) {
-			case P3_OBJ_MODE_8X8:
-				if (sprite->flip_vertical)
-					tile = g_get_obj_tile(S(obj_chr_base) |
-					                       (sprite->tile << 4) |
-					                       (7 - range));
-				else
-					tile = g_get_obj_tile(S(obj_chr_base) |
-					                       (sprite->tile << 4) |
-					                       range);
-				break;
-
-			case P3_OBJ_MODE_8X16:
-				if (sprite->flip_vertical)
-					tile = g_get_tile(
-					               (((padr_t) sprite->tile & 1) << 12) |
-					               ((sprite->tile & 0xFE) << 4) |
-					               (((range & 8) ^ 8) << 1) | (7 - (range & 7)));
-				else
-					tile = g_get_tile(
-					               (((padr_t) sprite->tile & 1) << 12) |
-					               ((sprite->tile & 0xFE) << 4) |
-					               ((range & 8) << 1) | (range & 7));
-				break;
+		top = sprite_y > first ? sprite_y : first;
+		bottom = sprite_y + p->obj_mode - 1;
+		if (bottom > last) {
+			bottom = last;
+		}
+		for (row = top; row <= bottom; ++row) {
+			if (p->obj_bucket_count[row] < OBJ_MAX_PER_SCANLINE) {
+				p->obj_bucket[row][p->obj_bucket_count[row]++] = (byte) sprite_index;
 			}
-			/* Initialize sprite unit */
-			init_sprite_unit(S(sprite_count), *tile, *(tile + 8), sprite);
-
-			/* Check sprite limit */
-			if ((++S(sprite_count)) >= OBJ_MAX_PER_SCANLINE) {
-				break;
+			/* Note: sprite limit reached sets overflow flag too */
+			if (p->obj_bucket_count[row] == OBJ_MAX_PER_SCANLINE) {
+				p->obj_bucket_overflow[row] = TRUE;
 			}
 		}
 	}
-	/* Find for sprite overflow */
-	for (; sprite_index < OBJ_MAX; ++sprite_index) {
-		sprite_y = S(obj_memory)[sprite_index].y;
-		if (S(fix_obj_y)) {
+	p->obj_dirty_first = SCREEN_HEIGHT;
+	p->obj_dirty_last = -1;
+}
+
+/* Specialized for constant 'height' and 'fix_y', see sprite_evaluators */
+static forceinline void evaluate_sprites_t(P3_OBJECT *p, struct render_context *rc,
+                                           unsigned int height, BOOL fix_y)
+{
+	const byte *bucket = p->obj_bucket[rc->row];
+	unsigned int range;
+	byte sprite_y;
+	P3_SPRITE *sprite;
+	padr_t chr;
+	cadr_t address;
+
+	for (rc->sprite_count = 0; rc->sprite_count < p->obj_bucket_count[rc->row]; ++rc->sprite_count) {
+		sprite = &p->obj_memory[bucket[rc->sprite_count]];
+		sprite_y = sprite->y;
+		if (fix_y) {
 			--sprite_y;
 		}
-		range = S(frame_row) - sprite_y;
-		/* If sprite on current scanline ? */
-		if (range < S(obj_mode)) {
-			S(obj_overflow) = TRUE;
-			return;
+		range = rc->row - sprite_y;
+		if (height == P3_OBJ_MODE_8X8) {
+			if (sprite->flip_vertical)
+				chr = rc->obj_chr_base | (sprite->tile << 4) | (7 - range);
+			else
+				chr = rc->obj_chr_base | (sprite->tile << 4) | range;
+		} else {
+			if (sprite->flip_vertical)
+				chr = (((padr_t) sprite->tile & 1) << 12) |
+				      ((sprite->tile & 0xFE) << 4) |
+				      (((range & 8) ^ 8) << 1) | (7 - (range & 7));
+			else
+				chr = (((padr_t) sprite->tile & 1) << 12) |
+				      ((sprite->tile & 0xFE) << 4) |
+				      ((range & 8) << 1) | (range & 7);
 		}
+		address = MAP_CHR_ADDRESS(p, chr);
+		/* Initialize sprite unit */
+		init_sprite_unit(p, rc, rc->sprite_count, address, sprite);
+	}
+	/* More than eight sprites on scanline */
+	if (p->obj_bucket_overflow[rc->row]) {
+		rc->obj_overflow = TRUE;
 	}
 }
 
-static void render_sprite_buffer(void)
+static void evaluate_sprites_8x8(P3_OBJECT *p, struct render_context *rc)
+{
+	evaluate_sprites_t(p, rc, P3_OBJ_MODE_8X8, FALSE);
+}
+
+static void evaluate_sprites_8x8_fix_y(P3_OBJECT *p, struct render_context *rc)
+{
+	evaluate_sprites_t(p, rc, P3_OBJ_MODE_8X8, TRUE);
+}
+
+static void evaluate_sprites_8x16(P3_OBJECT *p, struct render_context *rc)
+{
+	evaluate_sprites_t(p, rc, P3_OBJ_MODE_8X16, FALSE);
+}
+
+static void evaluate_sprites_8x16_fix_y(P3_OBJECT *p, struct render_context *rc)
+{
+	evaluate_sprites_t(p, rc, P3_OBJ_MODE_8X16, TRUE);
+}
+
+/* Index is [8x16 mode][fix_obj_y] */
+static void (*const sprite_evaluators[2][2])(P3_OBJECT *, struct render_context *) = {
+	{evaluate_sprites_8x8, evaluate_sprites_8x8_fix_y},
+	{evaluate_sprites_8x16, evaluate_sprites_8x16_fix_y}
+};
+
+/* Render sprites of scanline rc->row + 1 */
+static void render_sprite_buffer(P3_OBJECT *p, struct render_context *rc)
 {
 	sprite_index_t i;
 
 	/* Skip last row */
-	if (S(frame_row) == 239) {
+	if (rc->row == 239) {
 		return;
 	}
 
+	/* Callback may change sprites during frame */
+	if (p->obj_dirty_first <= p->obj_dirty_last) {
+		rebuild_sprite_buckets(p);
+	}
+
 	/* Initialize sprite units */
-	evaluate_sprites();
+	sprite_evaluators[p->obj_mode == P3_OBJ_MODE_8X16][p->fix_obj_y ? 1 : 0](p, rc);
 
 	/* Clear buffer */
-	memset(S(sprite_buffer), 0, sizeof(S(sprite_buffer)));
+	memset(rc->sprite_buffer, 0, sizeof(rc->sprite_buffer));
 
 	/* Overlay sprite units to buffer */
-	for (i = 0; i < S(sprite_count); ++i) {
-		overlay_sprite_unit(i);
+	for (i = 0; i < rc->sprite_count; ++i) {
+		overlay_sprite_unit(rc, i);
 	}
 }
 
-static forceinline void refetch_background_tile(void)
+static forceinline void fetch_tile_span(P3_OBJECT *p, struct render_context *rc, byte *dst)
 {
-	/* Get background tile with row offset */
-	byte *tile = g_get_bg_tile(S(bg_chr_base) | (get_nametable_byte() << 4) |
-	                                 S(vfy));
-	S(bg_tile_lo) = *tile;
-	S(bg_tile_hi) = *(tile + 8);
-	S(bg_tile_attributes) = (get_attribute_byte() >> ((S(vcx) & 2) | ((S(vcy) & 2) << 1))) & 3;
-	S(bg_tile_attributes) <<= 2;
+	padr_t offset = p->page_bases[rc->vpg] | (rc->vcy << 5) | rc->vcx;
+	byte name = p->page_memory[offset];
+	byte attributes;
+	cadr_t address;
+	int i;
+
+	if (p->ext_attributes_enabled) {
+		/* Extended attribute selects palette and 4 KB bank of tile */
+		byte ext = p->ext_memory[offset];
+		attributes = (ext >> 6) << 2;
+		address = p->ext_banks[ext & 0x3f] | (name << 4) | rc->vfy;
+	} else {
+		/* Main mapping selects pattern table by address bit 12 */
+		padr_t chr = rc->bg_chr_base | (name << 4) | rc->vfy;
+		address = MAP_CHR_ADDRESS(p, chr);
+		attributes = p->page_memory[(offset & 0xc00) | 960 | ((rc->vcx >> 2) | (rc->vcy & 0x1c) << 1)];
+		attributes = ((attributes >> ((rc->vcx & 2) | ((rc->vcy & 2) << 1))) & 3) << 2;
+	}
+	next_tile(rc);
+
+	if (p->tile_cache) {
+		/* Copy decoded pixels */
+		const byte *row = get_cached_row(p, address, FALSE);
+		for (i = 0; i < 8; ++i) {
+			dst[i] = attributes | row[i];
+		}
+	} else {
+		byte lo = p->tileset_pointer[address];
+		byte hi = p->tileset_pointer[address + 8];
+		/* Decode eight pixels, leftmost pixel in bit 7 */
+		for (i = 7; i >= 0; --i, ++dst) {
+			*dst = attributes | ((lo >> i) & 1) | (((hi >> i) << 1) & 2);
+		}
+	}
 }
 
-static void fetch_tile(void)
+static void render_background_line(P3_OBJECT *p, struct render_context *rc)
 {
-	if (S(frame_row_pos) != 256) {
-		refetch_background_tile();
-		move_to_next_tile();
+	byte *dst = rc->bg_buffer;
+	/* Fine x scroll needs one more tile to fill right border */
+	int count = rc->vfx ? 33 : 32;
+	int t;
+
+	for (t = 0; t < count; ++t, dst += 8) {
+		fetch_tile_span(p, rc, dst);
 	}
 }
 
-static forceinline void write_pixel(void)
+/* Copy background line from pre-rendered plane, plane is made for one
+   pattern table and doesn't hold rows 30 and 31 of attribute memory */
+static BOOL copy_background_line(P3_OBJECT *p, struct render_context *rc)
 {
-	/* Get background tile color index */
-	S(bg_color_index) = ((S(bg_tile_lo) >> (7 - S(vfx))) & 1) |
-		(((S(bg_tile_hi) >> (7 - S(vfx))) << 1) & 2);
-	S(bg_color_index) = (S(bg_tile_attributes) | S(bg_color_index)) & 
-		~S(bg_clip_mask) & S(bg_show_mask);
-
-	/* Get sprite tile color index + sprite priority in bit 7 */
-	S(obj_color_index) = S(sprite_buffer)[S(frame_row_pos)] &
-		~S(obj_clip_mask) & S(obj_show_mask);
+	if (p->bg_plane && (rc->vcy < 30) && (rc->bg_chr_base == p->bg_plane_chr_base)) {
+		g_read_bg_plane_line(p, rc->bg_buffer, ((rc->vpg & 1) << 5) | rc->vcx,
+		                     (((rc->vpg >> 1) * 30 + rc->vcy) << 3) | rc->vfy);
+		return TRUE;
+	}
+	return FALSE;
+}
 
+/* Copy frame state which raster table may change */
+static void init_band_state(const P3_OBJECT *p, struct render_context *rc)
+{
+	rc->tpg = p->tpg;
+	rc->tcx = p->tcx;
+	rc->tcy = p->tcy;
+	rc->tfx = p->tfx;
+	rc->tfy = p->tfy;
+	rc->bg_chr_base = p->bg_chr_base;
+	rc->obj_chr_base = p->obj_chr_base;
+	rc->show_bg = p->show_bg;
+	rc->show_obj = p->show_obj;
+	rc->clip_bg = p->clip_bg;
+	rc->clip_obj = p->clip_obj;
+	memcpy(rc->palette, p->palette_memory, sizeof(rc->palette));
+}
 
-	/* Mix color indexes using next rule:
-	   If (foreground sprite or transparent background tile)
-	   and opaque sprite tile, write sprite pixel, else write background tile pixel */
-	S(frame_buffer)[S(frame_pos)] = S(tint_value) |
-	    S(palette_memory)[(((S(obj_color_index) & 0x80) || !(S(bg_color_index) & 3)) && (S(obj_color_index) & 3)) ?
-	                              S(obj_color_index) & 0x1F : S(bg_color_index)] & S(grayscale_mask);
+static void update_compose_state(const P3_OBJECT *p, struct render_context *rc)
+{
+	g_setup_compose_state(&rc->cs, rc->palette, p->tint_value, p->grayscale_mask,
+	                      rc->show_bg, rc->show_obj, rc->clip_bg, rc->clip_obj);
+}
 
-	++S(frame_pos);
-	++S(frame_row_pos);        /* Note: increment here, see fetch_tile */
+/* Apply raster table entry to render context, returns entry flags */
+static int apply_raster_line(struct render_context *rc, const P3_RASTER_LINE *line)
+{
+	int flags = line->flags;
 
-	/* Goto next pixel */
-	if (++S(vfx) & 8) {
-		fetch_tile();
-		S(vfx) = 0;
+	if (flags & P3_RASTER_SCROLL_X) {
+		rc->tcx = line->scroll_x >> 3;
+		rc->tfx = line->scroll_x & 7;
+	}
+	if (flags & P3_RASTER_SCROLL_Y) {
+		rc->tcy = line->scroll_y >> 3;
+		rc->tfy = line->scroll_y & 7;
+	}
+	if (flags & P3_RASTER_PAGE) {
+		rc->tpg = line->page & 3;
+	}
+	if (flags & P3_RASTER_BG_CHR_TABLE) {
+		rc->bg_chr_base = (line->bg_chr_table & 1) * 0x1000;
+	}
+	if (flags & P3_RASTER_OBJ_CHR_TABLE) {
+		rc->obj_chr_base = (line->obj_chr_table & 1) * 0x1000;
+	}
+	if (flags & P3_RASTER_SHOW) {
+		rc->show_bg = TO_BOOL(line->show_bg);
+		rc->show_obj = TO_BOOL(line->show_obj);
+	}
+	if (flags & P3_RASTER_CLIP) {
+		rc->clip_bg = TO_BOOL(line->clip_bg);
+		rc->clip_obj = TO_BOOL(line->clip_obj);
 	}
+	if (flags & P3_RASTER_PALETTE) {
+		int i, count = line->palette_count < 8 ? line->palette_count : 8;
+		for (i = 0; i < count; ++i) {
+			int idx = (line->palette_index + i) & 0x1f;
+			byte col = line->palette[i] & 0x3f;
+			/* Same mirroring of canvas color as p3_set_color() */
+			if (!(idx & 3)) {
+				int j;
+				for (j = 0; j < 8; ++j) {
+					rc->palette[j * 4] = col;
+				}
+			} else {
+				rc->palette[idx] = col;
+			}
+		}
+	}
+	return flags;
+}
 
-	/* Make clip mask for next pixel */
-	S(bg_clip_mask) >>= 4;
-	S(obj_clip_mask) >>= 4;
+/* Scanline of render target, stride of caller surface is in bytes */
+static forceinline uint16_t *get_frame_line(P3_OBJECT *p, int row)
+{
+	if (p->render_target) {
+		return (uint16_t *) (p->render_target + row * p->render_target_stride);
+	}
+	return p->frame_buffer + row * SCREEN_WIDTH;
 }
 
-static void render_frame(void)
+/* Convert finished scanline while it's in cache */
+static forceinline void output_scanline(P3_OBJECT *p, int row)
 {
-	int t;
+	if (p->rgb_dst) {
+		g_convert_line(p->rgb_dst + row * p->rgb_stride, get_frame_line(p, row),
+		               p->rgb_format, p->rgb_lut);
+	}
+}
 
-	S(frame_pos) = 0;
-	S(obj_overflow) = FALSE;
-	/* Clear sprite render buffer for first scanline */
-	memset(S(sprite_buffer), 0, sizeof(S(sprite_buffer)));
-	p3_update_register(P3_REGISTER_V);
-	/* Render each scanline */
-	for (S(frame_row) = 0; S(frame_row) < SCREEN_HEIGHT; ++S(frame_row)) {
-		S(frame_row_pos) = 0;
+/* Prepare band state for rendering from scanline first */
+static void begin_band(P3_OBJECT *p, struct render_context *rc, int first)
+{
+	const P3_RASTER_LINE *table = p->raster_table;
+	int row;
+
+	/* Band state is state of frame after raster table entries above band */
+	init_band_state(p, rc);
+	if (table) {
+		for (row = 0; row < first; ++row) {
+			apply_raster_line(rc, &table[row]);
+		}
+	}
+	update_compose_state(p, rc);
+	seek_scanline(rc, first);
+	rc->obj_overflow = FALSE;
+
+	/* First scanline has no sprites, others need sprites of previous one */
+	if (first) {
+		rc->row = first - 1;
+		render_sprite_buffer(p, rc);
+	} else {
+		memset(rc->sprite_buffer, 0, sizeof(rc->sprite_buffer));
+	}
+	rc->row = first;
+}
 
-		S(bg_show_mask) = S(show_bg) ? 0xFF : 0x00;
-		S(obj_show_mask) = S(show_obj) ? 0xFF : 0x00;
-		S(bg_clip_mask) = S(clip_bg) ? 0xFFFFFFFF : 0x00000000;
-		S(obj_clip_mask) = S(clip_obj) ? 0xFFFFFFFF : 0x00000000;
+/* Render scanlines from rc->row to stop-1 of band ending at last */
+static void render_band_lines(P3_OBJECT *p, struct render_context *rc, int stop, int last)
+{
+	const P3_RASTER_LINE *table = p->raster_table;
 
-		/* Fetch data for first tile */
-		fetch_tile();
-
-		/* Render eight pixels per tile */
-		for (t = 0; t < 32; ++t) {
-			write_pixel();
-			write_pixel();
-			write_pixel();
-			write_pixel();
-			write_pixel();
-			write_pixel();
-			write_pixel();
-			write_pixel();
+	for (; rc->row < stop; ++rc->row) {
+		if (table) {
+			int flags = apply_raster_line(rc, &table[rc->row]);
+			if (flags & (P3_RASTER_SCROLL_X | P3_RASTER_SCROLL_Y | P3_RASTER_PAGE)) {
+				seek_scanline(rc, rc->row);
+			}
+			if (flags & (P3_RASTER_PALETTE | P3_RASTER_SHOW | P3_RASTER_CLIP)) {
+				update_compose_state(p, rc);
+			}
 		}
 
-		move_to_next_row();
+		/* Fetch whole scanline by tile spans, then skip fine x pixels.
+		   Hidden background doesn't change v register state of next scanline */
+		if (rc->show_bg && !copy_background_line(p, rc)) {
+			render_background_line(p, rc);
+		}
+		if (p->change_tracking) {
+			g_compose_line(rc->line_buffer, rc->bg_buffer + rc->vfx, rc->sprite_buffer, &rc->cs);
+			g_commit_line(p, rc->row, rc->line_buffer, get_frame_line(p, rc->row));
+		} else {
+			g_compose_line(get_frame_line(p, rc->row), rc->bg_buffer + rc->vfx, rc->sprite_buffer, &rc->cs);
+		}
+		output_scanline(p, rc->row);
 
-		/* Restore horizontal nametable from register t */
-		S(vpg) &= 2;
-		S(vpg) |= (S(tpg) & 1);
+		next_row(rc);
 
-		/* Restore horizontal position from register t */
-		S(vcx) = S(tcx);
-		S(vfx) = S(tfx);
+		/* Restore horizontal nametable and position from register t */
+		rc->vpg = (rc->vpg & 2) | (rc->tpg & 1);
+		rc->vcx = rc->tcx;
+		rc->vfx = rc->tfx;
 
-		/* Render sprites for next scanline */
-		render_sprite_buffer();
+		/* Render sprites for next scanline of band */
+		if (rc->row + 1 < last) {
+			render_sprite_buffer(p, rc);
+		}
 	}
+}
+
+/* Render scanlines first..last-1 without callbacks */
+static void render_band(P3_OBJECT *p, struct render_context *rc, int first, int last)
+{
+	begin_band(p, rc, first);
+	render_band_lines(p, rc, last, last);
+}
+
+static void begin_frame(P3_OBJECT *p3)
+{
+	g_prepare_tile_cache(p3);
+	g_prepare_bg_plane(p3);
+	p3x_update_register(p3, P3_REGISTER_V);
+	begin_band(p3, &S(ctx), 0);
+}
+
+static void render_frame_lines(P3_OBJECT *p3, int stop)
+{
+	render_band_lines(p3, &S(ctx), stop, SCREEN_HEIGHT);
+}
+
+static void end_frame(P3_OBJECT *p3)
+{
+	S(obj_overflow) = S(ctx).obj_overflow;
 
 	/* Restore v register from register t */
 	S(vpg) = S(tpg);
@@ -361,21 +675,121 @@ static void render_frame(void)
 	S(vfy) = S(tfy);
 }
 
-static forceinline void write_pixel_cb(void)
+static void render_frame(P3_OBJECT *p3)
 {
-	/* Pixel render event */
-	switch (S(callback_type)) {
-	case P3_CALLBACK_PIXEL:
-		S(callback_proc)(S(frame_row_pos), S(frame_row), S(callback_param));
-		break;
+	begin_frame(p3);
+	render_frame_lines(p3, SCREEN_HEIGHT);
+	end_frame(p3);
+}
 
-	case P3_CALLBACK_ONCE:
-		if ((S(frame_row_pos) == S(callback_x)) && (S(frame_row) == S(callback_y))) {
-			S(callback_proc)(S(frame_row_pos), S(frame_row), S(callback_param));
+/* Frame split in bands rendered by pool threads */
+struct band_frame {
+	P3_OBJECT *obj;
+	int nbands;
+	volatile long overflow;
+};
+
+static void render_band_job(void *context, long index)
+{
+	struct band_frame *frame = (struct band_frame *) context;
+	struct render_context rc;
+	int first = (int) (index * SCREEN_HEIGHT / frame->nbands);
+	int last = (int) ((index + 1) * SCREEN_HEIGHT / frame->nbands);
+
+	if (first < last) {
+		render_band(frame->obj, &rc, first, last);
+		if (rc.obj_overflow) {
+			g_atomic_increment(&frame->overflow);
 		}
-		break;
 	}
+}
+
+static void render_frame_parallel(P3_OBJECT *p3, int nbands)
+{
+	struct band_frame frame;
+	long i;
+
+	/* Workers may not decode tiles concurrently */
+	if (g_prepare_tile_cache(p3)) {
+		g_fill_tile_cache(p3);
+	}
+	if (g_prepare_bg_plane(p3)) {
+		g_fill_bg_plane(p3);
+	}
+	/* Sprite buckets are read only for render threads */
+	if (S(obj_dirty_first) <= S(obj_dirty_last)) {
+		rebuild_sprite_buckets(p3);
+	}
+	p3x_update_register(p3, P3_REGISTER_V);
+
+	frame.obj = p3;
+	frame.nbands = nbands;
+	frame.overflow = 0;
+	/* Without pool or while pool is busy with other run, render bands here */
+	if (!g_run_render_pool(render_band_job, &frame, nbands)) {
+		for (i = 0; i < nbands; ++i) {
+			render_band_job(&frame, i);
+		}
+	}
+	S(obj_overflow) = frame.overflow != 0;
+
+	/* Restore v register from register t */
+	S(vpg) = S(tpg);
+	S(vcy) = S(tcy);
+	S(vfy) = S(tfy);
+}
+
+/* * * * * * * * * * * * * * * Callback renderer * * * * * * * * * * * * * * */
+
+static forceinline cadr_t get_background_address(P3_OBJECT *p3)
+{
+	/* Background tile with row offset */
+	padr_t chr = S(bg_chr_base) | (get_nametable_byte(p3) << 4) | S(vfy);
+	return MAP_CHR_ADDRESS(p3, chr);
+}
+
+static forceinline byte get_background_attributes(P3_OBJECT *p3)
+{
+	return ((get_attribute_byte(p3) >> ((S(vcx) & 2) | ((S(vcy) & 2) << 1))) & 3) << 2;
+}
+
+static forceinline void refetch_background_tile(P3_OBJECT *p3)
+{
+	const byte *tile;
+
+	if (S(ext_attributes_enabled)) {
+		/* Extended attribute selects palette and 4 KB bank of tile */
+		byte ext = S(ext_memory)[make_current_address(p3)];
+		tile = S(tileset_pointer) + (S(ext_banks)[ext & 0x3f] | (get_nametable_byte(p3) << 4) | S(vfy));
+		S(bg_tile_attributes) = (ext >> 6) << 2;
+	} else {
+		tile = S(tileset_pointer) + get_background_address(p3);
+		S(bg_tile_attributes) = get_background_attributes(p3);
+	}
+	S(bg_tile_lo) = *tile;
+	S(bg_tile_hi) = *(tile + 8);
+}
 
+static void fetch_tile(P3_OBJECT *p3)
+{
+	if (S(frame_row_pos) != 256) {
+		refetch_background_tile(p3);
+		move_to_next_tile(p3);
+	}
+}
+
+static void render_sprite_buffer_cb(P3_OBJECT *p3)
+{
+	S(ctx).row = S(frame_row);
+	S(ctx).obj_chr_base = S(obj_chr_base);
+	render_sprite_buffer(p3, &S(ctx));
+	if (S(ctx).obj_overflow) {
+		S(obj_overflow) = TRUE;
+	}
+}
+
+static forceinline void write_pixel_cb(P3_OBJECT *p3)
+{
 	/* Get background tile color index */
 	S(bg_color_index) = S(bg_tile_attributes) | ((S(bg_tile_lo) >> (7 - S(vfx))) & 1) |
 		(((S(bg_tile_hi) >> (7 - S(vfx))) << 1) & 2);
@@ -383,24 +797,23 @@ static forceinline void write_pixel_cb(void)
 	S(bg_color_index) = S(bg_color_index) & ~S(bg_clip_mask) & S(bg_show_mask);
 
 	/* Get sprite tile color index + sprite priority in bit 7 */
-	S(obj_color_index) = S(sprite_buffer)[S(frame_row_pos)] &
+	S(obj_color_index) = S(ctx).sprite_buffer[S(frame_row_pos)] &
 		~S(obj_clip_mask) & S(obj_show_mask);
 
 
 	/* Mix color indexes using next rule:
 	   If (foreground sprite or transparent background tile)
 	   and opaque sprite tile, write sprite pixel, else write background tile pixel */
-	S(frame_buffer)[S(frame_pos)] = S(tint_value) |
+	S(frame_line)[S(frame_row_pos)] = S(tint_value) |
 		S(palette_memory)[(((S(obj_color_index) & 0x80) || !(S(bg_color_index) & 3)) &&
 		    (S(obj_color_index) & 3)) ? S(obj_color_index) & 0x1F :
 			    S(bg_color_index)] & S(grayscale_mask);
 
-	++S(frame_pos);
 	++S(frame_row_pos);        /* Note: increment here, see fetch_tile */
 
 	/* Goto next pixel */
 	if (++S(vfx) & 8) {
-		fetch_tile();
+		fetch_tile(p3);
 		S(vfx) = 0;
 	}
 
@@ -409,22 +822,69 @@ static forceinline void write_pixel_cb(void)
 	S(obj_clip_mask) >>= 4;
 }
 
-static void render_frame_cb(void)
+/* Call events at current pixel, return position of next event on scanline */
+static int fire_raster_events(P3_OBJECT *p3)
 {
-	int t;
+	int x = S(frame_row_pos);
+	int y = S(frame_row);
+	BOOL once_fired = FALSE;
+	struct raster_event *event;
+
+	S(event_position) = (y << 8) | x;
+
+	if (S(callback_type) == P3_CALLBACK_PIXEL) {
+		S(callback_proc)(x, y, S(callback_param));
+	}
+
+	/* Note: callbacks may insert events, don't keep item pointer */
+	while ((S(frame_event_index) < S(frame_events).count) &&
+	       (S(frame_events).items[S(frame_event_index)].position == S(event_position)))
+	{
+		event = &S(frame_events).items[S(frame_event_index)++];
+		if (!event->legacy) {
+			event->proc(x, y, event->param);
+		} else if (!once_fired && (S(callback_type) == P3_CALLBACK_ONCE) &&
+		           (x == S(callback_x)) && (y == S(callback_y)))
+		{
+			/* P3_CALLBACK_ONCE position may be adjusted after it was queued */
+			once_fired = TRUE;
+			S(callback_proc)(x, y, S(callback_param));
+		}
+	}
+
+	if (S(callback_type) == P3_CALLBACK_PIXEL) {
+		return x + 1;
+	}
+	if (S(frame_event_index) < S(frame_events).count) {
+		event = &S(frame_events).items[S(frame_event_index)];
+		if (event->y == y) {
+			return event->x;
+		}
+	}
+	return SCREEN_WIDTH;
+}
 
-	S(frame_pos) = 0;
+static void begin_frame_cb(P3_OBJECT *p3)
+{
+	g_prepare_tile_cache(p3);
 	S(obj_overflow) = FALSE;
+	S(ctx).obj_overflow = FALSE;
 	/* Clear sprite render buffer for first scanline */
-	memset(S(sprite_buffer), 0, sizeof(S(sprite_buffer)));
-	p3_update_register(P3_REGISTER_V);
+	memset(S(ctx).sprite_buffer, 0, sizeof(S(ctx).sprite_buffer));
+	p3x_update_register(p3, P3_REGISTER_V);
+	g_start_frame_events(p3);
+	S(frame_row) = 0;
 
 	/* Begin frame rendering event */
 	S(callback_proc)(0, P3_CALLBACK_BEGIN, S(callback_param));
+}
 
-	/* Render each scanline */
-	for (S(frame_row) = 0; S(frame_row) < SCREEN_HEIGHT; ++S(frame_row)) {
+/* Render scanlines from frame_row to stop-1 */
+static void render_frame_lines_cb(P3_OBJECT *p3, int stop)
+{
+	for (; S(frame_row) < stop; ++S(frame_row)) {
 		S(frame_row_pos) = 0;
+		S(frame_line) = S(change_tracking) ? S(ctx).line_buffer : get_frame_line(p3, S(frame_row));
 
 		/* Begin scanline event */
 		if (S(callback_type) == P3_CALLBACK_SCANLINE) {
@@ -437,21 +897,17 @@ static void render_frame_cb(void)
 		S(obj_clip_mask) = S(clip_obj) ? 0xFFFFFFFF : 0x00000000;
 
 		/* Fetch data for first tile */
-		fetch_tile();
-
-		/* Render eight pixels per tile */
-		for (t = 0; t < 32; ++t) {
-			write_pixel_cb();
-			write_pixel_cb();
-			write_pixel_cb();
-			write_pixel_cb();
-			write_pixel_cb();
-			write_pixel_cb();
-			write_pixel_cb();
-			write_pixel_cb();
+		fetch_tile(p3);
+
+		/* Render pixels between raster events */
+		while (S(frame_row_pos) < SCREEN_WIDTH) {
+			int stop_x = fire_raster_events(p3);
+			while (S(frame_row_pos) < stop_x) {
+				write_pixel_cb(p3);
+			}
 		}
 
-		move_to_next_row();
+		move_to_next_row(p3);
 
 		/* Restore horizontal nametable from register t */
 		S(vpg) &= 2;
@@ -462,9 +918,17 @@ static void render_frame_cb(void)
 		S(vfx) = S(tfx);
 
 		/* Render sprites for next scanline */
-		render_sprite_buffer();
+		render_sprite_buffer_cb(p3);
+
+		if (S(change_tracking)) {
+			g_commit_line(p3, S(frame_row), S(frame_line), get_frame_line(p3, S(frame_row)));
+		}
+		output_scanline(p3, S(frame_row));
 	}
+}
 
+static void end_frame_cb(P3_OBJECT *p3)
+{
 	/* Restore v register from register t */
 	S(vpg) = S(tpg);
 	S(vcy) = S(tcy);
@@ -474,9 +938,21 @@ static void render_frame_cb(void)
 	S(callback_proc)(0, P3_CALLBACK_END, S(callback_param));
 }
 
+/* Callbacks use current object API, so object is made current object of
+   rendering thread for the frame */
+static void render_frame_cb(P3_OBJECT *p3)
+{
+	P3_OBJECT *prev_obj = g_thread_p3obj;
+
+	g_thread_p3obj = p3;
+	begin_frame_cb(p3);
+	render_frame_lines_cb(p3, SCREEN_HEIGHT);
+	end_frame_cb(p3);
+	g_thread_p3obj = prev_obj;
+}
+
 P3_OBJECT *p3_create_object(void *chr, int chr_size)
 {
-	P3_OBJECT *prev_obj = g_p3obj;
 	P3_OBJECT *obj = malloc(sizeof(P3_OBJECT));
 	if (!obj) {
 		set_last_error("p3_create_object(): out of memory");
@@ -504,48 +980,64 @@ P3_OBJECT *p3_create_object(void *chr, int chr_size)
 	obj->callback_proc = default_callback;
 	obj->last_attribute_pos = P3_ATTRIBUTE_TOP_LEFT;
 
-	g_p3obj = obj;
-	g_initialize_tileset(chr, chr_size);
-	g_initialize_mapper();
-	p3_reset(P3_RESET_ALL | P3_RESET_BUFS);
-	p3_enable(TRUE);
-	g_p3obj = prev_obj;
+	g_initialize_compositor();
+	g_initialize_tileset(obj, chr, chr_size);
+	g_initialize_mapper(obj);
+	p3x_reset(obj, P3_RESET_ALL | P3_RESET_BUFS);
+	p3x_enable(obj, TRUE);
 
-	if (g_p3obj == NULL) {
-		g_p3obj = obj;
+	if (g_process_p3obj == NULL) {
+		g_process_p3obj = obj;
 	}
 	return obj;
 }
 
+/* NULL destroys current object of calling thread */
 void p3_destroy_object(P3_OBJECT **obj)
 {
 	if (obj) {
 		if (*obj) {
-			if (g_p3obj == *obj) {
-				g_p3obj = NULL;
+			if (g_process_p3obj == *obj) {
+				g_process_p3obj = NULL;
 			}
+			if (g_thread_p3obj == *obj) {
+				g_thread_p3obj = NULL;
+			}
+			g_release_tile_cache(*obj);
+			g_release_bg_plane(*obj);
+			g_release_events(*obj);
+			g_release_chr_file(*obj);
+			g_release_pager(*obj);
+			g_release_ext_attributes(*obj);
+			g_release_dirty_tiles(*obj);
 			free(*obj);
 			*obj = NULL;
 		} else {
 			set_last_error("p3_destroy_object(): bad 'obj' argument");
 		}
 	} else {
-		if (g_p3obj) {
-			free(g_p3obj);
-			g_p3obj = NULL;
+		P3_OBJECT *current = g_p3obj;
+		if (current) {
+			p3_destroy_object(&current);
 		}
 	}
 }
 
+/* Current object of process, used by threads without own current object */
 void p3_select_object(P3_OBJECT *obj)
 {
 	if (obj) {
-		g_p3obj = obj;
+		g_process_p3obj = obj;
 	} else {
 		set_last_error("p3_select_object(): bad 'obj' argument");
 	}
 }
 
+/* Current object of calling thread only, NULL returns thread to current
+   object of process. Threads using p3_ functions concurrently select own
+   objects this way */
+void p3_select_thread_object(P3_OBJECT *obj) { g_thread_p3obj = obj; }
+
 P3_OBJECT *p3_get_current_object(void) { return g_p3obj; }
 
 P3_OBJECT *p3_clone_object(P3_OBJECT *obj)
@@ -555,6 +1047,7 @@ P3_OBJECT *p3_clone_object(P3_OBJECT *obj)
 		set_last_error("p3_clone_object(): out of memory");
 		return NULL;
 	}
+	memset(new_obj, 0x00, sizeof(P3_OBJECT));
 	p3_copy_object(new_obj, obj);
 	return new_obj;
 }
@@ -562,7 +1055,30 @@ P3_OBJECT *p3_clone_object(P3_OBJECT *obj)
 void p3_copy_object(P3_OBJECT *dst, P3_OBJECT *src)
 {
 	if (dst && src) {
-		memcpy(dst, src, sizeof(P3_OBJECT));
+		if (dst != src) {
+			g_release_tile_cache(dst);
+			g_release_bg_plane(dst);
+			g_release_events(dst);
+			g_release_chr_file(dst);
+			g_release_pager(dst);
+			g_release_ext_attributes(dst);
+			g_release_dirty_tiles(dst);
+			memcpy(dst, src, sizeof(P3_OBJECT));
+			g_copy_chr_file(dst);
+			g_copy_pager(dst);
+			g_copy_ext_attributes(dst);
+			g_copy_dirty_tiles(dst);
+			/* Copy builds own tile cache on first render */
+			dst->tile_cache = NULL;
+			dst->tile_cache_valid = NULL;
+			dst->bg_plane = NULL;
+			dst->bg_plane_valid = NULL;
+			g_copy_events(dst, src);
+			/* Copy renders into own frame buffer */
+			dst->render_target = NULL;
+			dst->render_target_stride = 0;
+			dst->frame_valid = FALSE;
+		}
 	} else {
 		set_last_error("p3_copy_object(): bad arguments");
 	}
@@ -570,40 +1086,45 @@ void p3_copy_object(P3_OBJECT *dst, P3_OBJECT *src)
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
-int p3_is_enabled(void) { return S(enabled); }
+int p3x_is_enabled(P3_OBJECT *p3) { return S(enabled); }
 
-void p3_enable(int flag)
+void p3x_enable(P3_OBJECT *p3, int flag)
 {
 	if (S(idle)) {
 		S(enabled) = TO_BOOL(flag);
+		STATE_CHANGED();
 	}
 }
 
-void p3_reset(int flags)
+void p3x_reset(P3_OBJECT *p3, int flags)
 {
+	STATE_CHANGED();
+	if (flags & (P3_RESET_NAMETABLES | P3_RESET_ATTRIBUTTES)) {
+		g_invalidate_bg_plane(p3);
+	}
 	if (flags & P3_RESET_NAMETABLES) {
 		int i;
 		for (i = 0; i < 4; ++i) {
-			memset(S(page_memory) + S(mirroring_function)(i) * 1024, 0, 960);
+			memset(S(page_memory) + S(page_bases)[i], 0, 960);
 		}
 	}
 
 	if (flags & P3_RESET_ATTRIBUTTES) {
 		int i;
 		for (i = 0; i < 4; ++i) {
-			memset(S(page_memory) + S(mirroring_function)(i) * 1024 + 960, 0, 64);
+			memset(S(page_memory) + S(page_bases)[i] + 960, 0, 64);
 		}
 	}
 
 	if (flags & P3_RESET_BG_PALETTE) {
 		memset(S(bg_palette), 0, 16);
-		p3_set_color(0, 0);
+		p3x_set_color(p3, 0, 0);
 	}
 
 	if (flags & P3_RESET_OBJ_PALETTE) {
 		memset(S(obj_palette), 0, 16);
 		/* Restore canvas color */
-		p3_set_color(0, S(bg_palette)[0]);
+		p3x_set_color(p3, 0, S(bg_palette)[0]);
 	}
 
 	if (flags & P3_RESET_OBJ) {
@@ -611,6 +1132,7 @@ void p3_reset(int flags)
 		for (i = 0; i < OBJ_MAX; ++i) {
 			S(obj_memory)[i] = default_sprite;
 		}
+		mark_all_sprite_rows(p3);
 	}
 
 	if (flags & P3_RESET_T_REGISTER) {
@@ -622,63 +1144,67 @@ void p3_reset(int flags)
 	}
 
 	if (flags & P3_RESET_CALLBACK) {
-		p3_enable_callback(FALSE);
+		p3x_enable_callback(p3, FALSE);
 		S(callback_type) = P3_CALLBACK_SCANLINE;
 		S(callback_param) = NULL;
 		S(callback_x) = 0;
 		S(callback_y) = 0;
 		S(callback_proc) = default_callback;
+		p3x_clear_raster_events(p3);
 	}
 
 	if (flags & P3_RESET_STATE) {
-		p3_enable(FALSE);
-		p3_set_increment(P3_INCREMENT_HORIZONTAL);
-		p3_show_bg(TRUE);
-		p3_show_obj(TRUE);
-		p3_clip_bg(FALSE);
-		p3_clip_obj(FALSE);
-		p3_enable_grayscale(FALSE);
-		p3_set_tint(P3_TINT_OFF);
-		p3_set_obj_mode(P3_OBJ_MODE_8X8);
-		p3_set_bg_chr_table(P3_CHR_TABLE_LEFT);
-		p3_set_obj_chr_table(P3_CHR_TABLE_RIGHT);
-		p3_fix_obj_y(FALSE);
-		p3_enable_callback(FALSE);
+		p3x_enable(p3, FALSE);
+		p3x_set_increment(p3, P3_INCREMENT_HORIZONTAL);
+		p3x_show_bg(p3, TRUE);
+		p3x_show_obj(p3, TRUE);
+		p3x_clip_bg(p3, FALSE);
+		p3x_clip_obj(p3, FALSE);
+		p3x_enable_grayscale(p3, FALSE);
+		p3x_set_tint(p3, P3_TINT_OFF);
+		p3x_set_obj_mode(p3, P3_OBJ_MODE_8X8);
+		p3x_set_bg_chr_table(p3, P3_CHR_TABLE_LEFT);
+		p3x_set_obj_chr_table(p3, P3_CHR_TABLE_RIGHT);
+		p3x_fix_obj_y(p3, FALSE);
+		p3x_enable_callback(p3, FALSE);
+		p3x_set_raster_table(p3, NULL);
 		if (S(idle)) {
-			S(sprite_count) = 0;
+			S(ctx).sprite_count = 0;
 			S(obj_overflow) = FALSE;
 		}
 	}
 
 	if (flags & P3_RESET_BUFS) {
 		memset(S(frame_buffer), 0, sizeof(S(frame_buffer)));
-		memset(S(sprite_buffer), 0, sizeof(S(sprite_buffer)));
+		memset(S(ctx).sprite_buffer, 0, sizeof(S(ctx).sprite_buffer));
 	}
 }
 
-int p3_is_show_bg(void) { return S(show_bg); }
+int p3x_is_show_bg(P3_OBJECT *p3) { return S(show_bg); }
 
-void p3_show_bg(int flag)
+void p3x_show_bg(P3_OBJECT *p3, int flag)
 {
 	S(show_bg) = TO_BOOL(flag);
+	STATE_CHANGED();
 	if (S(callback_enabled)) {
 		S(bg_show_mask) = S(show_bg) ? 0xFF : 0x00;
 	}
 }
 
-int p3_is_show_obj(void) { return S(show_obj); }
+int p3x_is_show_obj(P3_OBJECT *p3) { return S(show_obj); }
 
-void p3_show_obj(int flag)
+void p3x_show_obj(P3_OBJECT *p3, int flag)
 {
 	S(show_obj) = TO_BOOL(flag);
+	STATE_CHANGED();
 	if (S(callback_enabled)) {
 		S(obj_show_mask) = S(show_obj) ? 0xFF : 0x00;
 	}
 }
 
-int p3_is_clip_bg(void) { return S(clip_bg); }
+int p3x_is_clip_bg(P3_OBJECT *p3) { return S(clip_bg); }
 
-void p3_clip_bg(int flag)
+void p3x_clip_bg(P3_OBJECT *p3, int flag)
 {
 	if (flag) {
 		if (S(callback_enabled) && (S(frame_row_pos) < 8)) {
@@ -688,11 +1214,12 @@ void p3_clip_bg(int flag)
 		S(bg_clip_mask) = 0;
 	}
 	S(clip_bg) = TO_BOOL(flag);
+	STATE_CHANGED();
 }
 
-int p3_is_clip_obj(void) { return S(clip_obj); }
+int p3x_is_clip_obj(P3_OBJECT *p3) { return S(clip_obj); }
 
-void p3_clip_obj(int flag)
+void p3x_clip_obj(P3_OBJECT *p3, int flag)
 {
 	if (flag) {
 		if (S(callback_enabled) && (S(frame_row_pos) < 8)) {
@@ -702,88 +1229,106 @@ void p3_clip_obj(int flag)
 		S(obj_clip_mask) = 0;
 	}
 	S(clip_obj) = TO_BOOL(flag);
+	STATE_CHANGED();
+}
+
+int p3x_is_grayscale(P3_OBJECT *p3) { return S(grayscale_mask) == GRAYSCALE_MASK_ON; }
+
+void p3x_enable_grayscale(P3_OBJECT *p3, int flag)
+{
+	S(grayscale_mask) = flag ? GRAYSCALE_MASK_ON : GRAYSCALE_MASK_OFF;
+	STATE_CHANGED();
 }
 
-int p3_is_grayscale(void) { return S(grayscale_mask) == GRAYSCALE_MASK_ON; }
-void p3_enable_grayscale(int flag) { S(grayscale_mask) = flag ? GRAYSCALE_MASK_ON : GRAYSCALE_MASK_OFF; }
-int p3_get_tint(void) { return S(tint_value) >> 6; }
+int p3x_get_tint(P3_OBJECT *p3) { return S(tint_value) >> 6; }
 
-void p3_set_tint(int tint)
+void p3x_set_tint(P3_OBJECT *p3, int tint)
 {
 	S(tint_value) = (uint16_t) (tint & P3_TINT_DARK) << 6;
+	STATE_CHANGED();
 }
 
-int p3_get_obj_mode(void) { return S(obj_mode); }
+int p3x_get_obj_mode(P3_OBJECT *p3) { return S(obj_mode); }
 
-void p3_set_obj_mode(int mode)
+void p3x_set_obj_mode(P3_OBJECT *p3, int mode)
 {
-	if ((mode == 8) || (mode == 16))
+	if ((mode == 8) || (mode == 16)) {
 		S(obj_mode) = (byte) mode;
-	else
+		mark_all_sprite_rows(p3);
+	} else
 		set_last_error("p3_set_obj_mode(): bad 'mode' argument");
 }
 
-int p3_get_bg_chr_table(void) { return S(bg_pattern_table); }
+int p3x_get_bg_chr_table(P3_OBJECT *p3) { return S(bg_pattern_table); }
 
-void p3_set_bg_chr_table(int table)
+void p3x_set_bg_chr_table(P3_OBJECT *p3, int table)
 {
 	if ((table == P3_CHR_TABLE_LEFT) || (table == P3_CHR_TABLE_RIGHT)) {
 		S(bg_pattern_table) = table;
 		S(bg_chr_base) = table * 0x1000;
-		g_update_mapper_fn();
+		g_update_mapper_fn(p3);
 	} else {
 		set_last_error("p3_set_bg_chr_table(): bad 'table' argument");
 	}
 }
 
-int p3_get_obj_chr_table(void) { return S(obj_pattern_table); }
+int p3x_get_obj_chr_table(P3_OBJECT *p3) { return S(obj_pattern_table); }
 
-void p3_set_obj_chr_table(int table)
+void p3x_set_obj_chr_table(P3_OBJECT *p3, int table)
 {
 	if ((table == P3_CHR_TABLE_LEFT) || (table == P3_CHR_TABLE_RIGHT)) {
 		S(obj_pattern_table) = table;
 		S(obj_chr_base) = table * 0x1000;
-		g_update_mapper_fn();
+		g_update_mapper_fn(p3);
 	} else {
 		set_last_error("p3_set_obj_chr_table(): bad 'table' argument");
 	}
 }
 
-int p3_get_page(void) { return S(tpg); }
-void p3_set_page(int page) { S(tpg) = page & 3; }
-int p3_get_scroll_x(void) { return (S(tcx) << 3) | S(tfx); }
+int p3x_get_page(P3_OBJECT *p3) { return S(tpg); }
+
+void p3x_set_page(P3_OBJECT *p3, int page)
+{
+	S(tpg) = page & 3;
+	STATE_CHANGED();
+}
+
+int p3x_get_scroll_x(P3_OBJECT *p3) { return (S(tcx) << 3) | S(tfx); }
 
-void p3_set_scroll_x(int value)
+void p3x_set_scroll_x(P3_OBJECT *p3, int value)
 {
 	value &= 0xff;
 	S(tcx) = value >> 3;
 	S(tfx) = value & 7;
+	STATE_CHANGED();
 }
 
-int p3_get_scroll_y(void) { return (S(tcy) << 3) | S(tfy); }
+int p3x_get_scroll_y(P3_OBJECT *p3) { return (S(tcy) << 3) | S(tfy); }
 
-void p3_set_scroll_y(int value)
+void p3x_set_scroll_y(P3_OBJECT *p3, int value)
 {
 	value &= 0xff;
 	S(tcy) = value >> 3;
 	S(tfy) = value & 7;
+	STATE_CHANGED();
 }
 
-void p3_set_scroll(int x, int y)
+void p3x_set_scroll(P3_OBJECT *p3, int x, int y)
 {
-	p3_set_scroll_x(x);
-	p3_set_scroll_y(y);
+	p3x_set_scroll_x(p3, x);
+	p3x_set_scroll_y(p3, y);
 }
 
-void p3_write_obj(const P3_SPRITE *obj)
+void p3x_write_obj(P3_OBJECT *p3, const P3_SPRITE *obj)
 {
-	if (obj)
+	if (obj) {
 		memcpy(S(obj_memory), obj, sizeof(S(obj_memory)));
-	else
+		mark_all_sprite_rows(p3);
+	} else
 		set_last_error("p3_write_obj(): bad 'obj' argument");
 }
 
-P3_SPRITE p3_get_sprite(int index)
+P3_SPRITE p3x_get_sprite(P3_OBJECT *p3, int index)
 {
 	if ((index >= 0) && (index < OBJ_MAX)) {
 		return S(obj_memory)[index];
@@ -794,36 +1339,42 @@ P3_SPRITE p3_get_sprite(int index)
 	}
 }
 
-void p3_put_sprite(int index, const P3_SPRITE *sprite)
+void p3x_put_sprite(P3_OBJECT *p3, int index, const P3_SPRITE *sprite)
 {
 	if (sprite)
-		if ((index >= 0) && (index < OBJ_MAX))
+		if ((index >= 0) && (index < OBJ_MAX)) {
+			/* Rebuild scanlines of old and new position */
+			mark_sprite_rows(p3, &S(obj_memory)[index]);
 			S(obj_memory)[index] = *sprite;
-		else
+			mark_sprite_rows(p3, sprite);
+		} else
 			set_last_error("p3_put_sprite(): 'index' out of range");
 	else
 		set_last_error("p3_put_sprite(): bad 'sprite' argument");
 }
 
-void p3_reset_sprite(int index)
+void p3x_reset_sprite(P3_OBJECT *p3, int index)
 {
-	if ((index >= 0) && (index < OBJ_MAX))
+	if ((index >= 0) && (index < OBJ_MAX)) {
+		mark_sprite_rows(p3, &S(obj_memory)[index]);
 		S(obj_memory)[index] = default_sprite;
-	else
+		mark_sprite_rows(p3, &default_sprite);
+	} else
 		set_last_error("p3_reset_sprite(): 'index' out of range");
 }
 
-int p3_is_sprite_overflow(void) { return S(obj_overflow); }
-int p3_is_fix_obj_y(void) { return S(fix_obj_y); }
+int p3x_is_sprite_overflow(P3_OBJECT *p3) { return S(obj_overflow); }
+int p3x_is_fix_obj_y(P3_OBJECT *p3) { return S(fix_obj_y); }
 
-void p3_fix_obj_y(int flag)
+void p3x_fix_obj_y(P3_OBJECT *p3, int flag)
 {
 	if (S(idle)) {
 		S(fix_obj_y) = TO_BOOL(flag);
+		mark_all_sprite_rows(p3);
 	}
 }
 
-void p3_read_palette(void *buf, int b_bg)
+void p3x_read_palette(P3_OBJECT *p3, void *buf, int b_bg)
 {
 	if (buf) {
 		if (b_bg) {
@@ -836,7 +1387,7 @@ void p3_read_palette(void *buf, int b_bg)
 	}
 }
 
-void p3_write_palette(const void *pal, int b_bg)
+void p3x_write_palette(P3_OBJECT *p3, const void *pal, int b_bg)
 {
 	if (pal) {
 		byte *dst = b_bg ? S(bg_palette) : S(obj_palette);
@@ -845,18 +1396,18 @@ void p3_write_palette(const void *pal, int b_bg)
 			dst[i] = ((const byte*) pal)[i] & 0x3f;
 
 		/* Restore/Update canvas color */
-		p3_set_color(0, S(bg_palette)[0]);
+		p3x_set_color(p3, 0, S(bg_palette)[0]);
 	} else {
 		set_last_error("p3_write_palette(): bad 'pal' argument");
 	}
 }
 
-int p3_get_color(int index)
+int p3x_get_color(P3_OBJECT *p3, int index)
 {
 	return S(palette_memory)[index & 0x1f];
 }
 
-void p3_set_color(int idx, int col)
+void p3x_set_color(P3_OBJECT *p3, int idx, int col)
 {
 	idx &= 0x1f;
 	col &= 0x3f;
@@ -868,27 +1419,28 @@ void p3_set_color(int idx, int col)
 	} else {
 		S(palette_memory)[idx] = col;
 	}
+	STATE_CHANGED();
 }
 
-int p3_get_palette_color(int pal, int col)
+int p3x_get_palette_color(P3_OBJECT *p3, int pal, int col)
 {
-	return p3_get_color((pal & 7) * 4 + (col & 3));
+	return p3x_get_color(p3, (pal & 7) * 4 + (col & 3));
 }
 
-void p3_set_palette_color(int pal, int col, int val)
+void p3x_set_palette_color(P3_OBJECT *p3, int pal, int col, int val)
 {
-	p3_set_color((pal & 7) * 4 + (col & 3), val & 0x3f);
+	p3x_set_color(p3, (pal & 7) * 4 + (col & 3), val & 0x3f);
 }
 
-int p3_get_canvas_color(void) { return p3_get_color(0); }
-void p3_set_canvas_color(int color) { p3_set_color(0, color); }
+int p3x_get_canvas_color(P3_OBJECT *p3) { return p3x_get_color(p3, 0); }
+void p3x_set_canvas_color(P3_OBJECT *p3, int color) { p3x_set_color(p3, 0, color); }
 
-int p3_get_bg_color(int pal, int col) { return p3_get_palette_color(pal, col); }
-void p3_set_bg_color(int pal, int col, int val) { p3_set_palette_color(pal, col, val); }
-int p3_get_obj_color(int pal, int col) { return p3_get_palette_color(4 + pal, col); }
-void p3_set_obj_color(int pal, int col, int val) { p3_set_palette_color(4 + pal, col, val); }
+int p3x_get_bg_color(P3_OBJECT *p3, int pal, int col) { return p3x_get_palette_color(p3, pal, col); }
+void p3x_set_bg_color(P3_OBJECT *p3, int pal, int col, int val) { p3x_set_palette_color(p3, pal, col, val); }
+int p3x_get_obj_color(P3_OBJECT *p3, int pal, int col) { return p3x_get_palette_color(p3, 4 + pal, col); }
+void p3x_set_obj_color(P3_OBJECT *p3, int pal, int col, int val) { p3x_set_palette_color(p3, 4 + pal, col, val); }
 
-int p3_get_register(int reg)
+int p3x_get_register(P3_OBJECT *p3, int reg)
 {
 	switch (reg) {
 	case P3_REGISTER_T:
@@ -925,7 +1477,7 @@ int p3_get_register(int reg)
 	}
 }
 
-void p3_set_register(int reg, int value)
+void p3x_set_register(P3_OBJECT *p3, int reg, int value)
 {
 	switch (reg) {
 	case P3_REGISTER_T:
@@ -1000,9 +1552,13 @@ void p3_set_register(int reg, int value)
 	default:
 		set_last_error("p3_set_register(): bad 'reg' argument");
 	}
+	/* Register v doesn't affect rendered frame */
+	if ((reg == P3_REGISTER_T) || ((reg >= P3_REGISTER_T_PAGE) && (reg <= P3_REGISTER_T_FINE_Y))) {
+		STATE_CHANGED();
+	}
 }
 
-void p3_update_register(int reg)
+void p3x_update_register(P3_OBJECT *p3, int reg)
 {
 	switch (reg) {
 	case P3_REGISTER_T:
@@ -1011,6 +1567,7 @@ void p3_update_register(int reg)
 		S(tcy) = S(vcy);
 		S(tfx) = S(vfx);
 		S(tfy) = S(vfy);
+		STATE_CHANGED();
 		break;
 
 	case P3_REGISTER_V:
@@ -1026,7 +1583,7 @@ void p3_update_register(int reg)
 	}
 }
 
-void p3_save_register(int reg)
+void p3x_save_register(P3_OBJECT *p3, int reg)
 {
 	switch (reg) {
 	case P3_REGISTER_T:
@@ -1050,7 +1607,7 @@ void p3_save_register(int reg)
 	}
 }
 
-void p3_restore_register(int reg)
+void p3x_restore_register(P3_OBJECT *p3, int reg)
 {
 	switch (reg) {
 	case P3_REGISTER_T:
@@ -1059,6 +1616,7 @@ void p3_restore_register(int reg)
 		S(tcy) = S(tmp_tcy);
 		S(tfx) = S(tmp_tfx);
 		S(tfy) = S(tmp_tfy);
+		STATE_CHANGED();
 		break;
 
 	case P3_REGISTER_V:
@@ -1074,87 +1632,100 @@ void p3_restore_register(int reg)
 	}
 }
 
-int p3_get_increment(void) { return S(increment_size); }
-void p3_set_increment(int inc) { S(increment_size) = inc; }
-int p3_get_address(void) { return p3_get_register(P3_REGISTER_V); }
-void p3_set_address(int adr) { p3_set_register(P3_REGISTER_V, adr); }
+int p3x_get_increment(P3_OBJECT *p3) { return S(increment_size); }
+void p3x_set_increment(P3_OBJECT *p3, int inc) { S(increment_size) = inc; }
+int p3x_get_address(P3_OBJECT *p3) { return p3x_get_register(p3, P3_REGISTER_V); }
+void p3x_set_address(P3_OBJECT *p3, int adr) { p3x_set_register(p3, P3_REGISTER_V, adr); }
 
-int p3_get_byte(void)
+int p3x_get_byte(P3_OBJECT *p3)
 {
-	byte value = S(page_memory)[make_current_address()];
-	increment_v_register();
+	byte value = S(page_memory)[make_current_address(p3)];
+	increment_v_register(p3);
 	return value;
 }
 
-void p3_put_byte(int value)
+void p3x_put_byte(P3_OBJECT *p3, int value)
 {
-	S(page_memory)[make_current_address()] = value & 0xff;
-	increment_v_register();
+	padr_t address = make_current_address(p3);
+
+	S(page_memory)[address] = value & 0xff;
+	STATE_CHANGED();
+	g_invalidate_bg_plane_byte(p3, address);
+	increment_v_register(p3);
 }
 
-int p3_get_byte_at(int adr)
+int p3x_get_byte_at(P3_OBJECT *p3, int adr)
 {
-	p3_set_address(adr);
-	return p3_get_byte();
+	p3x_set_address(p3, adr);
+	return p3x_get_byte(p3);
 }
 
-void p3_put_byte_at(int adr, int val)
+void p3x_put_byte_at(P3_OBJECT *p3, int adr, int val)
 {
-	p3_set_address(adr);
-	p3_put_byte(val);
+	p3x_set_address(p3, adr);
+	p3x_put_byte(p3, val);
 }
 
-void p3_read(void *dst, int num)
+void p3x_read(P3_OBJECT *p3, void *dst, int num)
 {
 	if (dst) {
 		byte *dst_ptr = (byte*) dst;
 		int i;
 		num &= 0xfff;
 		for (i = 0; i < num; ++i, ++dst_ptr) {
-			*dst_ptr = p3_get_byte();
+			*dst_ptr = p3x_get_byte(p3);
 		}
 	} else {
 		set_last_error("p3_read(): bad 'dst' argument");
 	}
 }
 
-void p3_write(const void *src, int num)
+void p3x_write(P3_OBJECT *p3, const void *src, int num)
 {
 	if (src) {
 		const byte *src_ptr = (const byte*) src;
 		int i;
 		num &= 0xfff;
 		for (i = 0; i < num; ++i, ++src_ptr) {
-			p3_put_byte(*src_ptr);
+			p3x_put_byte(p3, *src_ptr);
 		}
 	} else {
 		set_last_error("p3_write(): bad 'src' argument");
 	}
 }
 
-void p3_fill(int val, int num)
+void p3x_fill(P3_OBJECT *p3, int val, int num)
 {
 	int i;
 	val &= 0xff;
 	num &= 0xfff;
 	for (i = 0; i < num; ++i) {
-		p3_put_byte(val);
+		p3x_put_byte(p3, val);
 	}
 }
 
-void *p3_get_v_pointer(void) { return &S(page_memory)[make_current_address()]; }
-int p3_is_callback_enabled(void) { return S(callback_enabled); }
+void *p3x_get_v_pointer(P3_OBJECT *p3) { return &S(page_memory)[make_current_address(p3)]; }
+int p3x_is_callback_enabled(P3_OBJECT *p3) { return S(callback_enabled); }
 
-void p3_enable_callback(int flag)
+void p3x_enable_callback(P3_OBJECT *p3, int flag)
 {
 	if (S(idle)) {
 		S(callback_enabled) = TO_BOOL(flag);
 	}
 }
 
-P3_CALLBACK p3_get_callback(void) { return S(callback_proc); }
+P3_CALLBACK p3x_get_callback(P3_OBJECT *p3) { return S(callback_proc); }
+const P3_RASTER_LINE *p3x_get_raster_table(P3_OBJECT *p3) { return S(raster_table); }
+
+void p3x_set_raster_table(P3_OBJECT *p3, const P3_RASTER_LINE *table)
+{
+	if (S(idle)) {
+		S(raster_table) = table;
+		STATE_CHANGED();
+	}
+}
 
-void p3_set_callback(P3_CALLBACK proc, int type, int once_x, int once_y, void *param)
+void p3x_set_callback(P3_OBJECT *p3, P3_CALLBACK proc, int type, int once_x, int once_y, void *param)
 {
 	if (S(idle)) {
 		if (proc) {
@@ -1175,47 +1746,261 @@ void p3_set_callback(P3_CALLBACK proc, int type, int once_x, int once_y, void *p
 				set_last_error("p3_set_callback(): bad 'type' argument");
 			}
 		} else {
-			p3_reset(P3_RESET_CALLBACK);
+			p3x_reset(p3, P3_RESET_CALLBACK);
 		}
 	}
 }
 
-void p3_adjust_callback(int type, int once_x, int once_y)
+void p3x_adjust_callback(P3_OBJECT *p3, int type, int once_x, int once_y)
 {
 	if (S(callback_proc)) {
 		if (!S(idle)) {
 			S(callback_type) = type;
 			S(callback_x) = once_x;
 			S(callback_y) = once_y;
+			/* Queue next P3_CALLBACK_ONCE event of current frame */
+			if (type == P3_CALLBACK_ONCE) {
+				g_schedule_event(p3, S(callback_x), S(callback_y), S(callback_proc), S(callback_param), TRUE);
+			}
 		}
 	} else {
 		set_last_error("p3_adjust_callback(): logic error, p3_set_callback must be called prior");
 	}
 }
 
-void p3_reset_callback(void) { p3_reset(P3_RESET_CALLBACK); }
-void p3_refetch_tile(void) { refetch_background_tile(); }
+void p3x_reset_callback(P3_OBJECT *p3) { p3x_reset(p3, P3_RESET_CALLBACK); }
+
+static void fill_canvas(P3_OBJECT *p3)
+{
+	/* Note: NES PPU may use other palette entry here */
+	uint16_t col = S(bg_palette)[0];
+	uint16_t *ptr;
+	int i, j;
+	for (i = 0; i < SCREEN_HEIGHT; ++i) {
+		ptr = S(change_tracking) ? S(ctx).line_buffer : get_frame_line(p3, i);
+		for (j = 0; j < SCREEN_WIDTH; ++j)
+			ptr[j] = col;
+		if (S(change_tracking)) {
+			g_commit_line(p3, i, ptr, get_frame_line(p3, i));
+		}
+		output_scanline(p3, i);
+	}
+}
+void p3x_refetch_tile(P3_OBJECT *p3) { refetch_background_tile(p3); }
+
+/* Frame rendered without callbacks is kept until state is changed */
+static BOOL is_frame_unchanged(P3_OBJECT *p3)
+{
+	if (S(frame_valid) && !S(callback_enabled) && (S(frame_generation) == S(generation))) {
+		return !S(raster_table) ||
+		       !memcmp(S(frame_raster_table), S(raster_table), sizeof(S(frame_raster_table)));
+	}
+	return FALSE;
+}
 
-void p3_render(void)
+/* Returns TRUE if new frame must be rendered */
+static BOOL start_frame(P3_OBJECT *p3)
 {
 	if (S(idle)) {
+		g_reset_changes(p3);
+		g_start_pager_frame(p3);
+		return !is_frame_unchanged(p3);
+	}
+	return FALSE;
+}
+
+static void keep_frame(P3_OBJECT *p3)
+{
+	S(frame_valid) = !S(callback_enabled);
+	S(frame_generation) = S(generation);
+	if (S(frame_valid) && S(raster_table)) {
+		memcpy(S(frame_raster_table), S(raster_table), sizeof(S(frame_raster_table)));
+	}
+}
+
+/* Returns FALSE if frame isn't rendered, since it's unchanged */
+int p3x_render(P3_OBJECT *p3)
+{
+	if (start_frame(p3)) {
+		if (S(enabled)) {
+			S(idle) = FALSE;
+			if (S(callback_enabled)) {
+				render_frame_cb(p3);
+			} else {
+				render_frame(p3);
+			}
+			S(idle) = TRUE;
+		} else {
+			fill_canvas(p3);
+		}
+		keep_frame(p3);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/* Frame is split in 'nthreads' bands rendered on render pool of
+   p3_render_batch() and calling thread */
+int p3x_render_parallel(P3_OBJECT *p3, int nthreads)
+{
+	if (start_frame(p3)) {
 		if (S(enabled)) {
 			S(idle) = FALSE;
 			if (S(callback_enabled)) {
-				render_frame_cb();
+				/* Callbacks see state of previous scanlines, render serially */
+				render_frame_cb(p3);
+			} else if (nthreads > 1) {
+				render_frame_parallel(p3, nthreads < SCREEN_HEIGHT ? nthreads : SCREEN_HEIGHT);
 			} else {
-				render_frame();
+				render_frame(p3);
 			}
 			S(idle) = TRUE;
 		} else {
-			/* Note: NES PPU may use other palette entry here */
-			uint16_t col = S(bg_palette)[0];
-			uint16_t *ptr = S(frame_buffer);
-			int i;
-			for (i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; ++i)
-				*ptr++ = col;
+			fill_canvas(p3);
+		}
+		keep_frame(p3);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/* Touch object after writes through p3_get_v_pointer(), CHR writes through
+   p3_get_tile() or p3_get_chr_ptr() need p3_mark_dirty_tiles() instead */
+void p3x_touch(P3_OBJECT *p3)
+{
+	STATE_CHANGED();
+	g_invalidate_bg_plane(p3);
+}
+
+/* Render frame by parts. Without render callback, scroll, page, CHR table
+   selection, show and clip flags, palette, tint and grayscale are latched at
+   p3_render_begin() (raster table entries change latched copy). Nametables,
+   attributes, ext attributes, CHR data and mapping, sprites and raster table
+   entries are read live by each p3_render_lines(), writes between calls show
+   on lines rendered after them. With render callback, all state is read live.
+   Frame is finished and object is idle again after p3_render_end() */
+void p3x_render_begin(P3_OBJECT *p3)
+{
+	if (S(idle)) {
+		S(idle) = FALSE;
+		S(frame_valid) = FALSE;
+		S(frame_open) = TRUE;
+		g_reset_changes(p3);
+		g_start_pager_frame(p3);
+		S(frame_cb) = S(callback_enabled);
+		S(frame_lines) = 0;
+		if (S(enabled)) {
+			if (S(frame_cb)) {
+				P3_OBJECT *prev_obj = g_thread_p3obj;
+				g_thread_p3obj = p3;
+				begin_frame_cb(p3);
+				g_thread_p3obj = prev_obj;
+			} else {
+				begin_frame(p3);
+			}
+		} else {
+			fill_canvas(p3);
+			S(frame_lines) = SCREEN_HEIGHT;
+		}
+	}
+}
+
+static void render_open_frame(P3_OBJECT *p3, int stop)
+{
+	if (stop > S(frame_lines)) {
+		if (S(frame_cb)) {
+			P3_OBJECT *prev_obj = g_thread_p3obj;
+			g_thread_p3obj = p3;
+			render_frame_lines_cb(p3, stop);
+			g_thread_p3obj = prev_obj;
+		} else {
+			render_frame_lines(p3, stop);
+		}
+		S(frame_lines) = stop;
+	}
+}
+
+void p3x_render_lines(P3_OBJECT *p3, int num)
+{
+	if (num >= 0) {
+		if (S(frame_open)) {
+			render_open_frame(p3, num < SCREEN_HEIGHT - S(frame_lines) ?
+			                  S(frame_lines) + num : SCREEN_HEIGHT);
+		}
+	} else {
+		set_last_error("p3_render_lines(): bad 'num' argument");
+	}
+}
+
+void p3x_render_end(P3_OBJECT *p3)
+{
+	if (S(frame_open)) {
+		render_open_frame(p3, SCREEN_HEIGHT);
+		if (S(enabled)) {
+			if (S(frame_cb)) {
+				P3_OBJECT *prev_obj = g_thread_p3obj;
+				g_thread_p3obj = p3;
+				end_frame_cb(p3);
+				g_thread_p3obj = prev_obj;
+			} else {
+				end_frame(p3);
+			}
+		}
+		S(frame_open) = FALSE;
+		S(idle) = TRUE;
+	}
+}
+
+/* Complete scanlines of frame being rendered by parts, or of last such frame */
+int p3x_get_rendered_lines(P3_OBJECT *p3) { return S(frame_lines); }
+
+/* Render and write each scanline to RGB surface too */
+void p3x_render_rgb(P3_OBJECT *p3, void *dst, int stride, int format, const void *palette)
+{
+	if (dst) {
+		if ((format >= P3_FORMAT_RGBA8888) && (format <= P3_FORMAT_RGB565)) {
+			if (S(idle)) {
+				g_initialize_compositor();
+				g_build_rgb_lut(S(rgb_lut), format, (const unsigned int *) palette);
+				S(rgb_dst) = (byte *) dst;
+				S(rgb_stride) = stride;
+				S(rgb_format) = format;
+				/* RGB surface needs frame even if it's unchanged */
+				S(frame_valid) = FALSE;
+				p3x_render(p3);
+				S(rgb_dst) = NULL;
+			}
+		} else {
+			set_last_error("p3_render_rgb(): bad 'format' argument");
 		}
+	} else {
+		set_last_error("p3_render_rgb(): bad 'dst' argument");
 	}
 }
 
-const void *p3_get_frame_pointer(void) { return S(frame_buffer); }
+const void *p3x_get_frame_pointer(P3_OBJECT *p3) { return get_frame_line(p3, 0); }
+
+/* Render into caller surface at (x, y), NULL 'ptr' selects internal frame buffer */
+void p3x_set_render_target(P3_OBJECT *p3, void *ptr, int stride, int x, int y)
+{
+	if (S(idle)) {
+		if (ptr) {
+			byte *base = (byte *) ptr + (ptrdiff_t) y * stride + (ptrdiff_t) x * sizeof(uint16_t);
+			if ((x < 0) || (y < 0)) {
+				set_last_error("p3_set_render_target(): bad position");
+			} else if ((stride & 1) || ((size_t) base & 1) ||
+			           ((stride < SCREEN_WIDTH * (int) sizeof(uint16_t)) &&
+			            (stride > -SCREEN_WIDTH * (int) sizeof(uint16_t))))
+			{
+				set_last_error("p3_set_render_target(): bad 'stride' or alignment");
+			} else {
+				S(render_target) = base;
+				S(render_target_stride) = stride;
+			}
+		} else {
+			S(render_target) = NULL;
+			S(render_target_stride) = 0;
+		}
+		STATE_CHANGED();
+	}
+}
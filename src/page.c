@@ -21,26 +21,26 @@
 #include "p3.h"
 #include "common.h"
 
-void p3_zero_page(int page)
+void p3x_zero_page(P3_OBJECT *p3, int page)
 {
-	p3_zero_nametable(page);
-	p3_zero_attribute_table(page);
+	p3x_zero_nametable(p3, page);
+	p3x_zero_attribute_table(p3, page);
 }
 
-void p3_fill_page(int page, int tile, int pal)
+void p3x_fill_page(P3_OBJECT *p3, int page, int tile, int pal)
 {
-	p3_fill_nametable(page, tile);
-	p3_fill_attribute_table(page, pal);
+	p3x_fill_nametable(p3, page, tile);
+	p3x_fill_attribute_table(p3, page, pal);
 }
 
-void p3_read_page(int page, void *buf)
+void p3x_read_page(P3_OBJECT *p3, int page, void *buf)
 {
-	p3_read_nametable(page, buf);
-	p3_read_attribute_table(page,  (byte*) buf + 960);
+	p3x_read_nametable(p3, page, buf);
+	p3x_read_attribute_table(p3, page,  (byte*) buf + 960);
 }
 
-void p3_write_page(int page, const void *data)
+void p3x_write_page(P3_OBJECT *p3, int page, const void *data)
 {
-	p3_write_nametable(page, data);
-	p3_write_attribute_table(page, (const byte*) data + 960);
+	p3x_write_nametable(p3, page, data);
+	p3x_write_attribute_table(p3, page, (const byte*) data + 960);
 }
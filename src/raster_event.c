@@ -0,0 +1,172 @@
+/*
+ Copyright (C) 2019 Dmitry Korunos
+
+ This software is provided 'as-is', without any express or implied
+ warranty. In no event will the authors be held liable for any damages
+ arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it
+ freely, subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+ 2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+ 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "p3.h"
+#include "common.h"
+
+USE_P3_OBJECT;
+
+/* Internal interface of module */
+void g_start_frame_events(P3_OBJECT *p3);
+void g_schedule_event(P3_OBJECT *p3, int x, int y, P3_CALLBACK proc, void *param, BOOL legacy);
+void g_release_events(P3_OBJECT *obj);
+void g_copy_events(P3_OBJECT *dst, const P3_OBJECT *src);
+
+/* Position of event in frame */
+#define EVENT_POSITION(X, Y) (((int) (Y) << 8) | (X))
+
+static BOOL reserve_events(struct event_queue *queue, int count)
+{
+	if (count > queue->capacity) {
+		int capacity = queue->capacity ? queue->capacity * 2 : 16;
+		struct raster_event *items;
+		if (capacity < count) {
+			capacity = count;
+		}
+		items = (struct raster_event *) realloc(queue->items, capacity * sizeof(struct raster_event));
+		if (!items) {
+			return FALSE;
+		}
+		queue->items = items;
+		queue->capacity = capacity;
+	}
+	return TRUE;
+}
+
+/* Insert after all events at same or earlier position, starting search at 'from' */
+static BOOL insert_event(struct event_queue *queue, int from, const struct raster_event *event)
+{
+	int i;
+
+	if (!reserve_events(queue, queue->count + 1)) {
+		return FALSE;
+	}
+	for (i = queue->count; (i > from) && (queue->items[i - 1].position > event->position); --i) {
+		queue->items[i] = queue->items[i - 1];
+	}
+	queue->items[i] = *event;
+	++queue->count;
+	return TRUE;
+}
+
+static void make_event(struct raster_event *event, int x, int y, P3_CALLBACK proc, void *param, BOOL legacy)
+{
+	event->position = EVENT_POSITION(x, y);
+	event->x = (byte) x;
+	event->y = (byte) y;
+	event->legacy = legacy;
+	event->proc = proc;
+	event->param = param;
+}
+
+/* Build queue of frame: registered events and P3_CALLBACK_ONCE callback */
+void g_start_frame_events(P3_OBJECT *p3)
+{
+	struct event_queue *frame = &S(frame_events);
+
+	frame->count = 0;
+	S(frame_event_index) = 0;
+	S(event_position) = -1;
+	if (reserve_events(frame, S(raster_events).count)) {
+		if (S(raster_events).count) {
+			memcpy(frame->items, S(raster_events).items,
+			       S(raster_events).count * sizeof(struct raster_event));
+		}
+		frame->count = S(raster_events).count;
+	} else {
+		set_last_error("p3_render(): out of memory, raster events skipped");
+	}
+	if (S(callback_type) == P3_CALLBACK_ONCE) {
+		g_schedule_event(p3, S(callback_x), S(callback_y), S(callback_proc), S(callback_param), TRUE);
+	}
+}
+
+/* Add event to frame being rendered, if frame doesn't pass its position yet */
+void g_schedule_event(P3_OBJECT *p3, int x, int y, P3_CALLBACK proc, void *param, BOOL legacy)
+{
+	struct raster_event event;
+
+	make_event(&event, x, y, proc, param, legacy);
+	if (event.position > S(event_position)) {
+		if (!insert_event(&S(frame_events), S(frame_event_index), &event)) {
+			set_last_error("g_schedule_event(): out of memory");
+		}
+	}
+}
+
+void g_release_events(P3_OBJECT *obj)
+{
+	free(obj->raster_events.items);
+	free(obj->frame_events.items);
+	memset(&obj->raster_events, 0, sizeof(obj->raster_events));
+	memset(&obj->frame_events, 0, sizeof(obj->frame_events));
+}
+
+/* Object copy gets own copy of registered events */
+void g_copy_events(P3_OBJECT *dst, const P3_OBJECT *src)
+{
+	int count = src->raster_events.count;
+
+	memset(&dst->raster_events, 0, sizeof(dst->raster_events));
+	memset(&dst->frame_events, 0, sizeof(dst->frame_events));
+	if (count) {
+		if (reserve_events(&dst->raster_events, count)) {
+			memcpy(dst->raster_events.items, src->raster_events.items,
+			       count * sizeof(struct raster_event));
+			dst->raster_events.count = count;
+		} else {
+			set_last_error("p3_copy_object(): out of memory, raster events not copied");
+		}
+	}
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Events are kept until p3_clear_raster_events(), event added during
+   rendering is called only in current frame */
+void p3x_add_raster_event(P3_OBJECT *p3, int x, int y, P3_CALLBACK proc, void *param)
+{
+	if (proc) {
+		if ((x >= 0) && (x < SCREEN_WIDTH) && (y >= 0) && (y < SCREEN_HEIGHT)) {
+			if (S(idle)) {
+				struct raster_event event;
+				make_event(&event, x, y, proc, param, FALSE);
+				if (!insert_event(&S(raster_events), 0, &event)) {
+					set_last_error("p3_add_raster_event(): out of memory");
+				}
+			} else {
+				g_schedule_event(p3, x, y, proc, param, FALSE);
+			}
+		} else {
+			set_last_error("p3_add_raster_event(): position out of range");
+		}
+	} else {
+		set_last_error("p3_add_raster_event(): bad 'proc' argument");
+	}
+}
+
+void p3x_clear_raster_events(P3_OBJECT *p3)
+{
+	if (S(idle)) {
+		S(raster_events).count = 0;
+	}
+}
+
+int p3x_get_raster_event_count(P3_OBJECT *p3) { return S(raster_events).count; }
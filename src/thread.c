@@ -0,0 +1,253 @@
+/*
+ Copyright (C) 2019 Dmitry Korunos
+
+ This software is provided 'as-is', without any express or implied
+ warranty. In no event will the authors be held liable for any damages
+ arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it
+ freely, subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+ 2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+ 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#if defined(__linux__)
+	/* pthread_setaffinity_np() */
+	#define _GNU_SOURCE
+#endif
+
+#if defined(_WIN32)
+	#include <windows.h>
+	#include <process.h>
+#else
+	#include <pthread.h>
+	#include <unistd.h>
+	#if defined(__linux__)
+		#include <sched.h>
+	#endif
+#endif
+#include "p3.h"
+#include "common.h"
+
+/* Internal interface of module */
+struct p3_thread *g_start_thread(void (*proc)(void *), void *param);
+void g_join_thread(struct p3_thread *thread);
+void g_set_thread_affinity(struct p3_thread *thread, int cpu);
+int g_get_cpu_count(void);
+struct p3_semaphore *g_create_semaphore(void);
+void g_destroy_semaphore(struct p3_semaphore *sem);
+void g_post_semaphore(struct p3_semaphore *sem, int count);
+void g_wait_semaphore(struct p3_semaphore *sem);
+long g_atomic_increment(volatile long *value);
+void g_lock_process(void);
+void g_unlock_process(void);
+
+struct p3_thread {
+#if defined(_WIN32)
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+	void (*proc)(void *);
+	void *param;
+};
+
+struct p3_semaphore {
+#if defined(_WIN32)
+	HANDLE handle;
+#else
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int count;
+#endif
+};
+
+#if defined(_WIN32)
+static unsigned __stdcall thread_entry(void *param)
+#else
+static void *thread_entry(void *param)
+#endif
+{
+	struct p3_thread *thread = (struct p3_thread *) param;
+	thread->proc(thread->param);
+	return 0;
+}
+
+/* Returns NULL if thread can't be started */
+struct p3_thread *g_start_thread(void (*proc)(void *), void *param)
+{
+	struct p3_thread *thread = (struct p3_thread *) malloc(sizeof(struct p3_thread));
+	if (!thread) {
+		return NULL;
+	}
+	thread->proc = proc;
+	thread->param = param;
+#if defined(_WIN32)
+	thread->handle = (HANDLE) _beginthreadex(NULL, 0, thread_entry, thread, 0, NULL);
+	if (!thread->handle) {
+		free(thread);
+		return NULL;
+	}
+#else
+	if (pthread_create(&thread->handle, NULL, thread_entry, thread)) {
+		free(thread);
+		return NULL;
+	}
+#endif
+	return thread;
+}
+
+void g_join_thread(struct p3_thread *thread)
+{
+#if defined(_WIN32)
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+#else
+	pthread_join(thread->handle, NULL);
+#endif
+	free(thread);
+}
+
+/* Affinity is hint only, ignored if not supported */
+void g_set_thread_affinity(struct p3_thread *thread, int cpu)
+{
+#if defined(_WIN32)
+	if ((cpu >= 0) && (cpu < (int) (sizeof(DWORD_PTR) * 8))) {
+		SetThreadAffinityMask(thread->handle, (DWORD_PTR) 1 << cpu);
+	}
+#elif defined(__linux__)
+	if ((cpu >= 0) && (cpu < CPU_SETSIZE)) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_setaffinity_np(thread->handle, sizeof(set), &set);
+	}
+#endif
+}
+
+int g_get_cpu_count(void)
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int) info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int) count : 1;
+#endif
+}
+
+/* Counting semaphore, initially zero. Returns NULL if can't be created */
+struct p3_semaphore *g_create_semaphore(void)
+{
+	struct p3_semaphore *sem = (struct p3_semaphore *) malloc(sizeof(struct p3_semaphore));
+	if (!sem) {
+		return NULL;
+	}
+#if defined(_WIN32)
+	sem->handle = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+	if (!sem->handle) {
+		free(sem);
+		return NULL;
+	}
+#else
+	if (pthread_mutex_init(&sem->mutex, NULL)) {
+		free(sem);
+		return NULL;
+	}
+	if (pthread_cond_init(&sem->cond, NULL)) {
+		pthread_mutex_destroy(&sem->mutex);
+		free(sem);
+		return NULL;
+	}
+	sem->count = 0;
+#endif
+	return sem;
+}
+
+void g_destroy_semaphore(struct p3_semaphore *sem)
+{
+	if (sem) {
+#if defined(_WIN32)
+		CloseHandle(sem->handle);
+#else
+		pthread_cond_destroy(&sem->cond);
+		pthread_mutex_destroy(&sem->mutex);
+#endif
+		free(sem);
+	}
+}
+
+void g_post_semaphore(struct p3_semaphore *sem, int count)
+{
+#if defined(_WIN32)
+	ReleaseSemaphore(sem->handle, count, NULL);
+#else
+	pthread_mutex_lock(&sem->mutex);
+	sem->count += count;
+	if (count > 1) {
+		pthread_cond_broadcast(&sem->cond);
+	} else {
+		pthread_cond_signal(&sem->cond);
+	}
+	pthread_mutex_unlock(&sem->mutex);
+#endif
+}
+
+void g_wait_semaphore(struct p3_semaphore *sem)
+{
+#if defined(_WIN32)
+	WaitForSingleObject(sem->handle, INFINITE);
+#else
+	pthread_mutex_lock(&sem->mutex);
+	while (sem->count == 0) {
+		pthread_cond_wait(&sem->cond, &sem->mutex);
+	}
+	--sem->count;
+	pthread_mutex_unlock(&sem->mutex);
+#endif
+}
+
+/* Returns incremented value */
+long g_atomic_increment(volatile long *value)
+{
+#if defined(_WIN32)
+	return InterlockedIncrement(value);
+#else
+	return __sync_add_and_fetch(value, 1);
+#endif
+}
+
+/* Process-wide lock of short sections, statically initialized */
+#if defined(_WIN32)
+static volatile long process_lock = 0;
+#else
+static pthread_mutex_t process_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+void g_lock_process(void)
+{
+#if defined(_WIN32)
+	while (InterlockedCompareExchange(&process_lock, 1, 0)) {
+		Sleep(0);
+	}
+#else
+	pthread_mutex_lock(&process_mutex);
+#endif
+}
+
+void g_unlock_process(void)
+{
+#if defined(_WIN32)
+	InterlockedExchange(&process_lock, 0);
+#else
+	pthread_mutex_unlock(&process_mutex);
+#endif
+}
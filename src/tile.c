@@ -21,7 +21,7 @@
 #include "p3.h"
 #include "common.h"
 
-static int make_tile_index_1(int table, int index)
+static int make_tile_index_1(P3_OBJECT *p3, int table, int index)
 {
 	index &= 0xff;
 	switch (table) {
@@ -32,10 +32,10 @@ static int make_tile_index_1(int table, int index)
 		return 256 + index;
 
 	case P3_CHR_TABLE_BG:
-		return p3_get_bg_chr_table() * 256 + index;
+		return p3x_get_bg_chr_table(p3) * 256 + index;
 
 	case P3_CHR_TABLE_OBJ:
-		return p3_get_obj_chr_table() * 256 + index;
+		return p3x_get_obj_chr_table(p3) * 256 + index;
 
 	default:
 		set_last_error("make_tile_index_1(): bad 'table' argument");
@@ -43,7 +43,7 @@ static int make_tile_index_1(int table, int index)
 	}
 }
 
-static int make_tile_index_2(int table, int x, int y)
+static int make_tile_index_2(P3_OBJECT *p3, int table, int x, int y)
 {
 	switch (table) {
 	case P3_CHR_TABLE_LEFT:
@@ -56,10 +56,10 @@ static int make_tile_index_2(int table, int x, int y)
 		return (y & 0x0f) * 32 + (x & 0x1f);
 
 	case P3_CHR_TABLE_BG:
-		return p3_get_bg_chr_table() * 256 + (y & 0x0f) * 16 + (x & 0x0f);
+		return p3x_get_bg_chr_table(p3) * 256 + (y & 0x0f) * 16 + (x & 0x0f);
 
 	case P3_CHR_TABLE_OBJ:
-		return p3_get_obj_chr_table() * 256 + (y & 0x0f) * 16 + (x & 0x0f);
+		return p3x_get_obj_chr_table(p3) * 256 + (y & 0x0f) * 16 + (x & 0x0f);
 
 	default:
 		set_last_error("make_tile_index_2(): bad 'table' argument");
@@ -218,10 +218,10 @@ int p3_is_equal_tiles(const void *tile1, const void *tile2)
 	return 0;
 }
 
-int p3_make_tile_index_1m(int index) { return p3_map_tile(index); }
-int p3_make_tile_index_1t(int table, int index) { return make_tile_index_1(table, index); }
-int p3_make_tile_index_1tm(int table, int index) { return p3_map_tile(p3_make_tile_index_1t(table, index)); }
-int p3_make_tile_index_2(int x, int y) { return make_tile_index_2(P3_CHR_TABLE_PPU, x, y); }
-int p3_make_tile_index_2m(int x, int y) { return p3_map_tile(p3_make_tile_index_2(x, y)); }
-int p3_make_tile_index_2t(int table, int x, int y) { return make_tile_index_2(table, x, y); }
-int p3_make_tile_index_2tm(int table, int x, int y) { return p3_map_tile(p3_make_tile_index_2t(table, x, y)); }
+int p3x_make_tile_index_1m(P3_OBJECT *p3, int index) { return p3x_map_tile(p3, index); }
+int p3x_make_tile_index_1t(P3_OBJECT *p3, int table, int index) { return make_tile_index_1(p3, table, index); }
+int p3x_make_tile_index_1tm(P3_OBJECT *p3, int table, int index) { return p3x_map_tile(p3, p3x_make_tile_index_1t(p3, table, index)); }
+int p3x_make_tile_index_2(P3_OBJECT *p3, int x, int y) { return make_tile_index_2(p3, P3_CHR_TABLE_PPU, x, y); }
+int p3x_make_tile_index_2m(P3_OBJECT *p3, int x, int y) { return p3x_map_tile(p3, p3x_make_tile_index_2(p3, x, y)); }
+int p3x_make_tile_index_2t(P3_OBJECT *p3, int table, int x, int y) { return make_tile_index_2(p3, table, x, y); }
+int p3x_make_tile_index_2tm(P3_OBJECT *p3, int table, int x, int y) { return p3x_map_tile(p3, p3x_make_tile_index_2t(p3, table, x, y)); }
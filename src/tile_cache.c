@@ -0,0 +1,153 @@
+/*
+ Copyright (C) 2019 Dmitry Korunos
+
+ This software is provided 'as-is', without any express or implied
+ warranty. In no event will the authors be held liable for any damages
+ arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it
+ freely, subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+ 2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+ 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "p3.h"
+#include "common.h"
+
+USE_P3_OBJECT;
+
+/* Internal interface of module */
+void g_decode_tile_row(byte *dst, byte lo, byte hi, BOOL flip);
+void g_decode_cached_tile(P3_OBJECT *obj, cadr_t tile);
+BOOL g_prepare_tile_cache(P3_OBJECT *p3);
+void g_fill_tile_cache(P3_OBJECT *obj);
+void g_reset_tile_cache(P3_OBJECT *p3);
+void g_invalidate_tile_cache(P3_OBJECT *p3, int start, int num);
+void g_release_tile_cache(P3_OBJECT *obj);
+
+/* bg_plane.c module */
+void g_invalidate_bg_plane(P3_OBJECT *obj);
+
+/* Decoded tile: 8 rows of 8 pixels, then same rows flipped horizontally */
+#define CACHED_TILE_SIZE 128
+#define CACHED_FLIP_OFFSET 64
+
+void g_decode_tile_row(byte *dst, byte lo, byte hi, BOOL flip)
+{
+	int i;
+
+	if (flip) {
+		/* Leftmost pixel in bit 0 */
+		for (i = 0; i < 8; ++i, ++dst) {
+			*dst = ((lo >> i) & 1) | (((hi >> i) << 1) & 2);
+		}
+	} else {
+		/* Leftmost pixel in bit 7 */
+		for (i = 7; i >= 0; --i, ++dst) {
+			*dst = ((lo >> i) & 1) | (((hi >> i) << 1) & 2);
+		}
+	}
+}
+
+void g_decode_cached_tile(P3_OBJECT *obj, cadr_t tile)
+{
+	const byte *src = obj->tileset_pointer + (tile << 4);
+	byte *dst = obj->tile_cache + tile * CACHED_TILE_SIZE;
+	int row;
+
+	for (row = 0; row < 8; ++row) {
+		g_decode_tile_row(dst + row * 8, src[row], src[row + 8], FALSE);
+		g_decode_tile_row(dst + CACHED_FLIP_OFFSET + row * 8, src[row], src[row + 8], TRUE);
+	}
+	obj->tile_cache_valid[tile] = TRUE;
+}
+
+/* Decode all invalid tiles, then cache is read only for render threads */
+void g_fill_tile_cache(P3_OBJECT *obj)
+{
+	const byte *valid = obj->tile_cache_valid;
+	size_t count = obj->tileset_storage >> 4;
+	const byte *invalid = (const byte*) memchr(valid, FALSE, count);
+	while (invalid) {
+		size_t tile = invalid - valid;
+		g_decode_cached_tile(obj, (cadr_t) tile);
+		invalid = (const byte*) memchr(invalid + 1, FALSE, count - tile - 1);
+	}
+}
+
+void g_release_tile_cache(P3_OBJECT *obj)
+{
+	free(obj->tile_cache);
+	free(obj->tile_cache_valid);
+	obj->tile_cache = NULL;
+	obj->tile_cache_valid = NULL;
+}
+
+/* Allocate cache if enabled, cache memory isn't shared by object copies */
+BOOL g_prepare_tile_cache(P3_OBJECT *p3)
+{
+	if (S(tile_cache_enabled) && !S(tile_cache)) {
+		size_t count = S(tileset_storage) >> 4;
+		S(tile_cache) = (byte*) malloc(count * CACHED_TILE_SIZE);
+		S(tile_cache_valid) = (byte*) calloc(count, 1);
+		if (!S(tile_cache) || !S(tile_cache_valid)) {
+			g_release_tile_cache(p3);
+			S(tile_cache_enabled) = FALSE;
+			set_last_error("p3_enable_tile_cache(): out of memory");
+			return FALSE;
+		}
+	}
+	return S(tile_cache) != NULL;
+}
+
+void g_reset_tile_cache(P3_OBJECT *p3)
+{
+	STATE_CHANGED();
+	g_invalidate_bg_plane(p3);
+	/* Tileset size may differ, allocate again */
+	g_release_tile_cache(p3);
+	g_prepare_tile_cache(p3);
+}
+
+/* Tiles are changed, cached or not */
+void g_invalidate_tile_cache(P3_OBJECT *p3, int start, int num)
+{
+	STATE_CHANGED();
+	g_invalidate_bg_plane(p3);
+	if (S(tile_cache_valid)) {
+		int count = S(tileset_storage) >> 4;
+		if (start < 0) {
+			num += start;
+			start = 0;
+		}
+		if (start + num > count) {
+			num = count - start;
+		}
+		if (num > 0) {
+			memset(S(tile_cache_valid) + start, FALSE, num);
+		}
+	}
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+int p3x_is_tile_cache_enabled(P3_OBJECT *p3) { return S(tile_cache_enabled); }
+
+void p3x_enable_tile_cache(P3_OBJECT *p3, int flag)
+{
+	if (S(idle)) {
+		S(tile_cache_enabled) = TO_BOOL(flag);
+		if (S(tile_cache_enabled)) {
+			g_prepare_tile_cache(p3);
+		} else {
+			g_release_tile_cache(p3);
+		}
+	}
+}
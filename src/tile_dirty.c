@@ -0,0 +1,205 @@
+/*
+ Copyright (C) 2019 Dmitry Korunos
+
+ This software is provided 'as-is', without any express or implied
+ warranty. In no event will the authors be held liable for any damages
+ arising from the use of this software.
+
+ Permission is granted to anyone to use this software for any purpose,
+ including commercial applications, and to alter it and redistribute it
+ freely, subject to the following restrictions:
+
+ 1. The origin of this software must not be misrepresented; you must not
+    claim that you wrote the original software. If you use this software
+    in a product, an acknowledgment in the product documentation would be
+    appreciated but is not required.
+ 2. Altered source versions must be plainly marked as such, and must not be
+    misrepresented as being the original software.
+ 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "p3.h"
+#include "common.h"
+
+/* Internal interface of module */
+void g_mark_dirty_tiles(P3_OBJECT *p3, int start, int num);
+void g_reset_dirty_tiles(P3_OBJECT *p3);
+void g_release_dirty_tiles(P3_OBJECT *obj);
+void g_copy_dirty_tiles(P3_OBJECT *dst);
+
+/* tile_cache.c module */
+void g_invalidate_tile_cache(P3_OBJECT *p3, int start, int num);
+
+/* Bitmap has bit of each tile of tileset, tile N is bit N % 8 of byte N / 8 */
+#define BITMAP_SIZE(P)                      ((((size_t) (P)->tileset_size >> 4) + 7) >> 3)
+
+/* Number of bits set in each value of nibble */
+static const byte nibble_bits[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+static int count_bits(byte value) { return nibble_bits[value & 15] + nibble_bits[value >> 4]; }
+
+/* Clip range of tiles to tileset, returns FALSE if nothing is left */
+static BOOL clip_tile_range(P3_OBJECT *p3, int *start, int *num)
+{
+	int count = S(tileset_size) >> 4;
+	if (*start < 0) {
+		*num += *start;
+		*start = 0;
+	}
+	if (*num > count - *start) {
+		*num = count - *start;
+	}
+	return *num > 0;
+}
+
+/* Set or clear bits of range, dirty_tile_count follows bits */
+static void change_bits(P3_OBJECT *p3, int start, int num, BOOL set)
+{
+	byte *bitmap = S(dirty_tiles);
+	int end = start + num;
+
+	/* Bits up to byte boundary, whole bytes, then rest of bits */
+	while ((start < end) && (start & 7)) {
+		byte bit = 1 << (start & 7);
+		if (TO_BOOL(bitmap[start >> 3] & bit) != set) {
+			bitmap[start >> 3] ^= bit;
+			S(dirty_tile_count) += set ? 1 : -1;
+		}
+		++start;
+	}
+	for (; start + 8 <= end; start += 8) {
+		byte *item = &bitmap[start >> 3];
+		S(dirty_tile_count) += set ? 8 - count_bits(*item) : -count_bits(*item);
+		*item = set ? 0xff : 0;
+	}
+	for (; start < end; ++start) {
+		byte bit = 1 << (start & 7);
+		if (TO_BOOL(bitmap[start >> 3] & bit) != set) {
+			bitmap[start >> 3] ^= bit;
+			S(dirty_tile_count) += set ? 1 : -1;
+		}
+	}
+}
+
+/* Bitmap is allocated by first change of tiles */
+void g_mark_dirty_tiles(P3_OBJECT *p3, int start, int num)
+{
+	if (clip_tile_range(p3, &start, &num)) {
+		if (!S(dirty_tiles)) {
+			S(dirty_tiles) = (byte *) calloc(BITMAP_SIZE(p3), 1);
+			S(dirty_tile_count) = 0;
+			if (!S(dirty_tiles)) {
+				set_last_error("g_mark_dirty_tiles(): out of memory, changes of tiles aren't tracked");
+				return;
+			}
+		}
+		change_bits(p3, start, num, TRUE);
+	}
+}
+
+/* Tileset is replaced, all tiles of new tileset are dirty */
+void g_reset_dirty_tiles(P3_OBJECT *p3)
+{
+	g_release_dirty_tiles(p3);
+	g_mark_dirty_tiles(p3, 0, S(tileset_size) >> 4);
+}
+
+void g_release_dirty_tiles(P3_OBJECT *obj)
+{
+	free(obj->dirty_tiles);
+	obj->dirty_tiles = NULL;
+	obj->dirty_tile_count = 0;
+}
+
+/* Object copy gets own copy of bitmap */
+void g_copy_dirty_tiles(P3_OBJECT *dst)
+{
+	const byte *src = dst->dirty_tiles;
+
+	if (src) {
+		dst->dirty_tiles = (byte *) malloc(BITMAP_SIZE(dst));
+		if (dst->dirty_tiles) {
+			memcpy(dst->dirty_tiles, src, BITMAP_SIZE(dst));
+		} else {
+			set_last_error("p3_copy_object(): out of memory, dirty tiles not copied");
+			dst->dirty_tile_count = 0;
+		}
+	}
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+int p3x_get_dirty_tile_count(P3_OBJECT *p3) { return S(dirty_tile_count); }
+
+int p3x_is_tile_dirty(P3_OBJECT *p3, int index)
+{
+	if ((index >= 0) && (index < (S(tileset_size) >> 4))) {
+		return S(dirty_tiles) ? (S(dirty_tiles)[index >> 3] >> (index & 7)) & 1 : 0;
+	}
+	set_last_error("p3_is_tile_dirty(): 'index' out of range");
+	return 0;
+}
+
+/* Index of first dirty tile at or after 'start', -1 if there is none */
+int p3x_find_dirty_tile(P3_OBJECT *p3, int start)
+{
+	int count = S(tileset_size) >> 4;
+
+	if (start < 0) {
+		start = 0;
+	}
+	if (S(dirty_tile_count)) {
+		const byte *bitmap = S(dirty_tiles);
+		while (start < count) {
+			byte item = bitmap[start >> 3] >> (start & 7);
+			if (item) {
+				/* Lowest set bit */
+				while (!(item & 1)) {
+					item >>= 1;
+					++start;
+				}
+				return start;
+			}
+			/* Skip to next byte */
+			start = (start | 7) + 1;
+		}
+	}
+	return -1;
+}
+
+/* Copy bitmap of all tiles, (tile count + 7) / 8 bytes */
+void p3x_read_dirty_tiles(P3_OBJECT *p3, void *buf)
+{
+	if (buf) {
+		if (S(dirty_tiles)) {
+			memcpy(buf, S(dirty_tiles), BITMAP_SIZE(p3));
+		} else {
+			memset(buf, 0, BITMAP_SIZE(p3));
+		}
+	} else {
+		set_last_error("p3_read_dirty_tiles(): bad 'buf' argument");
+	}
+}
+
+/* Tiles written through p3_get_tile(), p3_get_chr_ptr() or by other object
+   sharing same tileset are marked by caller, tile cache is invalidated */
+void p3x_mark_dirty_tiles(P3_OBJECT *p3, int start, int num)
+{
+	if (num >= 0) {
+		g_invalidate_tile_cache(p3, start, num);
+		g_mark_dirty_tiles(p3, start, num);
+	} else {
+		set_last_error("p3_mark_dirty_tiles(): bad 'num' argument");
+	}
+}
+
+void p3x_clear_dirty_tiles(P3_OBJECT *p3, int start, int num)
+{
+	if (num >= 0) {
+		if (S(dirty_tiles) && clip_tile_range(p3, &start, &num)) {
+			change_bits(p3, start, num, FALSE);
+		}
+	} else {
+		set_last_error("p3_clear_dirty_tiles(): bad 'num' argument");
+	}
+}
@@ -24,24 +24,44 @@
 USE_P3_OBJECT;
 
 /* Internal interface of module */
-BOOL g_initialize_tileset(void *tiles, int size);
+BOOL g_initialize_tileset(P3_OBJECT *p3, void *tiles, int size);
+BOOL g_is_valid_chr_size(size_t size);
+
+/* bank_pager.c module */
+cadr_t g_page_chr_address(P3_OBJECT *p3, cadr_t address);
+void g_release_pager(P3_OBJECT *obj);
+
+/* chr_file.c module */
+void g_release_chr_file(P3_OBJECT *obj);
+
+/* ext_attribute.c module */
+void g_update_ext_banks(P3_OBJECT *p3);
 
 /* mapper.c module */
-void g_check_banks();
+void g_update_mapper_fn(P3_OBJECT *p3);
+void g_check_banks(P3_OBJECT *p3);
+int g_map_tile_run(P3_OBJECT *p3, int index, int *tile);
+
+/* tile_cache.c module */
+void g_reset_tile_cache(P3_OBJECT *p3);
+void g_invalidate_tile_cache(P3_OBJECT *p3, int start, int num);
+
+/* tile_dirty.c module */
+void g_mark_dirty_tiles(P3_OBJECT *p3, int start, int num);
+void g_reset_dirty_tiles(P3_OBJECT *p3);
+
+/* Tileset is whole number of 8 KB banks, P3_CHR_SIZE_ sizes are common */
+BOOL g_is_valid_chr_size(size_t size)
+{
+	return (size >= P3_CHR_SIZE_8) && (size <= P3_CHR_SIZE_MAX) && !(size & (P3_CHR_SIZE_8 - 1));
+}
 
-BOOL g_initialize_tileset(void *chr, int chr_size)
+BOOL g_initialize_tileset(P3_OBJECT *p3, void *chr, int chr_size)
 {
-	if (chr && ((chr_size == P3_CHR_SIZE_8) ||
-               (chr_size == P3_CHR_SIZE_16) ||
-               (chr_size == P3_CHR_SIZE_32) ||
-               (chr_size == P3_CHR_SIZE_64) ||
-               (chr_size == P3_CHR_SIZE_128) ||
-               (chr_size == P3_CHR_SIZE_256) ||
-               (chr_size == P3_CHR_SIZE_512) ||
-               (chr_size == P3_CHR_SIZE_1024)))
-	{
+	if (chr && (chr_size > 0) && g_is_valid_chr_size((size_t) chr_size)) {
 		S(tileset_pointer) = (byte*) chr;
 		S(tileset_size) = chr_size;
+		S(tileset_storage) = chr_size;
 		return TRUE;
 	}
 	set_last_error("p3_set_chr_ptr(): bad arguments");
@@ -50,76 +70,234 @@ BOOL g_initialize_tileset(void *chr, int chr_size)
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
-void *p3_get_chr_ptr(void) { return S(tileset_pointer); }
+void *p3x_get_chr_ptr(P3_OBJECT *p3) { return S(tileset_pointer); }
 
-void p3_set_chr_ptr(void *chr, int chr_size)
+void p3x_set_chr_ptr(P3_OBJECT *p3, void *chr, int chr_size)
 {
-	if (g_initialize_tileset(chr, chr_size))
-		g_check_banks();
+	if (g_initialize_tileset(p3, chr, chr_size)) {
+		/* Caller's tileset replaces mapped file or paged tileset */
+		g_release_chr_file(p3);
+		g_release_pager(p3);
+		g_update_mapper_fn(p3);
+		g_update_ext_banks(p3);
+		g_reset_tile_cache(p3);
+		g_reset_dirty_tiles(p3);
+		g_check_banks(p3);
+	}
 }
 
-int p3_get_chr_size(void) { return S(tileset_size); }
-int p3_get_tile_count(void) { return S(tileset_size) >> 4; }
+int p3x_get_chr_size(P3_OBJECT *p3) { return S(tileset_size); }
+int p3x_get_tile_count(P3_OBJECT *p3) { return S(tileset_size) >> 4; }
 
 static byte bad_tile[16] = {0xaa,0xaa,0xaa,0xaa,0xaa,0xaa,0xaa,0xaa,
 	0x55,0x55,0x55,0x55,0x55,0x55,0x55,0x55};
 
-void *p3_get_tile(int index)
+void *p3x_get_tile(P3_OBJECT *p3, int index)
 {
-	if ((index >= 0) && (index < p3_get_tile_count()))
+	if ((index >= 0) && (index < p3x_get_tile_count(p3))) {
+		/* Tile of paged tileset is valid until next bank is loaded */
+		if (S(pager))
+			return S(tileset_pointer) + g_page_chr_address(p3, (cadr_t) index << 4);
 		return &S(tileset_pointer[index << 4]);
+	}
 
 	set_last_error("p3_get_tile(): 'index' out of range");
 	return bad_tile;
 }
 
-void p3_put_tile(int index, const void *tile)
+/* Mapped file and banks of paged tileset can't be changed */
+static BOOL is_read_only(P3_OBJECT *p3) { return S(chr_file) || S(pager); }
+
+void p3x_put_tile(P3_OBJECT *p3, int index, const void *tile)
 {
-	if (tile)
-		p3_copy_tile(p3_get_tile(index), tile);
-	else
+	if (tile) {
+		if (!is_read_only(p3)) {
+			p3_copy_tile(p3x_get_tile(p3, index), tile);
+			g_invalidate_tile_cache(p3, index, 1);
+			g_mark_dirty_tiles(p3, index, 1);
+		} else {
+			set_last_error("p3_put_tile(): tileset is read-only");
+		}
+	} else
 		set_last_error("p3_put_tile(): bad 'tile' argument");
 }
 
-void p3_copy_tiles(int dst, int src, int num, int b_mapdst, int b_mapsrc)
+/* Tiles of 8 KB bank of paged tileset */
+#define BANK_TILES                          512
+
+/* Run of tiles from 'index' of caller, contiguous in tileset. Returns
+   length of run up to 'num' and tileset index of its first tile */
+static int resolve_run(P3_OBJECT *p3, int index, int num, BOOL use_mmc, int *tile)
+{
+	int run, next;
+
+	if (!use_mmc) {
+		*tile = index;
+		return num;
+	}
+	run = g_map_tile_run(p3, index, tile);
+	/* Join following windows while they continue run */
+	while (run < num) {
+		int length = g_map_tile_run(p3, index + run, &next);
+		if (next != *tile + run)
+			break;
+		run += length;
+	}
+	return run < num ? run : num;
+}
+
+/* Number of tiles of run inside tileset, 0 if run starts out of tileset */
+static int clip_run(P3_OBJECT *p3, int tile, int run)
+{
+	int count = p3x_get_tile_count(p3);
+	if (tile >= count)
+		return 0;
+	return run < count - tile ? run : count - tile;
+}
+
+/* Tiles of run in memory, 'num' is cut to end of resident bank of paged
+   tileset. Pointer is valid until next bank is loaded */
+static byte *get_tile_span(P3_OBJECT *p3, int tile, int *num)
+{
+	if (S(pager)) {
+		int rest = BANK_TILES - (tile & (BANK_TILES - 1));
+		if (*num > rest)
+			*num = rest;
+		return S(tileset_pointer) + g_page_chr_address(p3, (cadr_t) tile << 4);
+	}
+	return S(tileset_pointer) + ((size_t) tile << 4);
+}
+
+/* Tiles out of tileset read as bad tile */
+static void fill_bad_tiles(byte *dst, int num)
+{
+	for (; num > 0; --num, dst += 16) {
+		p3_copy_tile(dst, bad_tile);
+	}
+}
+
+/* Tiles are copied in ascending order as by one tile, so destination
+   overlapping end of source repeats first tiles of source */
+static void copy_span(byte *dst, const byte *src, int num)
 {
-	int i;
-
-	dst &= 0xffff;
-	src &= 0xffff;
-	num &= 0xffff;
-	for (i = 0; i < num; ++i, ++src, ++dst) {
-		p3_copy_tile(p3_get_tile(b_mapdst ? p3_map_tile(dst) : dst),
-			  p3_get_tile(b_mapsrc ? p3_map_tile(src) : src));
+	size_t size = (size_t) num << 4;
+
+	if ((dst > src) && (dst < src + size)) {
+		size_t step = dst - src;
+		size_t done;
+		for (done = 0; done < size; done += step) {
+			memcpy(dst + done, src + done, size - done < step ? size - done : step);
+		}
+	} else {
+		memmove(dst, src, size);
 	}
 }
 
-void p3_read_tiles(void *buf, int start, int num, int b_usemmc)
+/* Written run of tiles must be decoded again and becomes dirty */
+static void commit_run(P3_OBJECT *p3, int tile, int num)
+{
+	g_invalidate_tile_cache(p3, tile, num);
+	g_mark_dirty_tiles(p3, tile, num);
+}
+
+/* Runs of source and destination are moved by spans contiguous in both,
+   tiles out of tileset are skipped and reported once */
+void p3x_copy_tiles(P3_OBJECT *p3, int dst, int src, int num, int b_mapdst, int b_mapsrc)
+{
+	if (!is_read_only(p3)) {
+		BOOL out_of_range = FALSE;
+		int run, i;
+
+		dst &= 0xffff;
+		src &= 0xffff;
+		num &= 0xffff;
+		for (i = 0; i < num; i += run) {
+			int dst_tile, src_tile, src_run, valid;
+			run = resolve_run(p3, dst + i, num - i, TO_BOOL(b_mapdst), &dst_tile);
+			src_run = resolve_run(p3, src + i, run, TO_BOOL(b_mapsrc), &src_tile);
+			run = clip_run(p3, dst_tile, src_run);
+			if (!run) {
+				run = src_run;
+				out_of_range = TRUE;
+				continue;
+			}
+			valid = clip_run(p3, src_tile, run);
+			if (valid) {
+				run = valid;
+				copy_span(S(tileset_pointer) + ((size_t) dst_tile << 4),
+				          S(tileset_pointer) + ((size_t) src_tile << 4), run);
+			} else {
+				fill_bad_tiles(S(tileset_pointer) + ((size_t) dst_tile << 4), run);
+				out_of_range = TRUE;
+			}
+			commit_run(p3, dst_tile, run);
+		}
+		if (out_of_range)
+			set_last_error("p3_copy_tiles(): tiles out of range");
+	} else {
+		set_last_error("p3_copy_tiles(): tileset is read-only");
+	}
+}
+
+void p3x_read_tiles(P3_OBJECT *p3, void *buf, int start, int num, int b_usemmc)
 {
 	if (buf) {
-		int i;
+		BOOL out_of_range = FALSE;
 		byte *dst = (byte *) buf;
+		int run, i;
 
 		start &= 0xffff;
 		num &= 0xffff;
-		for (i = 0; i < num; ++i, ++start, dst += 16) {
-			p3_copy_tile(dst, p3_get_tile(b_usemmc ? p3_map_tile(start) : start));
+		for (i = 0; i < num; i += run, dst += (size_t) run << 4) {
+			int tile, valid, n, done;
+			run = resolve_run(p3, start + i, num - i, TO_BOOL(b_usemmc), &tile);
+			valid = clip_run(p3, tile, run);
+			if (!valid) {
+				fill_bad_tiles(dst, run);
+				out_of_range = TRUE;
+				continue;
+			}
+			run = valid;
+			for (done = 0; done < run; done += n) {
+				const byte *span;
+				n = run - done;
+				span = get_tile_span(p3, tile + done, &n);
+				memcpy(dst + ((size_t) done << 4), span, (size_t) n << 4);
+			}
 		}
+		if (out_of_range)
+			set_last_error("p3_read_tiles(): tiles out of range");
 	} else {
 		set_last_error("p3_read_tiles(): bad 'buf' argument");
 	}
 }
 
-void p3_write_tiles(const void *tiles, int start, int num, int b_usemmc)
+void p3x_write_tiles(P3_OBJECT *p3, const void *tiles, int start, int num, int b_usemmc)
 {
 	if (tiles) {
-		int i;
-		const byte *src = (const byte *) tiles;
+		if (!is_read_only(p3)) {
+			BOOL out_of_range = FALSE;
+			const byte *src = (const byte *) tiles;
+			int run, i;
 
-		start &= 0xffff;
-		num &= 0xffff;
-		for (i = 0; i < num; ++i, ++start, src += 16) {
-			p3_copy_tile(p3_get_tile(b_usemmc ? p3_map_tile(start) : start), src);
+			start &= 0xffff;
+			num &= 0xffff;
+			for (i = 0; i < num; i += run, src += (size_t) run << 4) {
+				int tile, valid;
+				run = resolve_run(p3, start + i, num - i, TO_BOOL(b_usemmc), &tile);
+				valid = clip_run(p3, tile, run);
+				if (!valid) {
+					out_of_range = TRUE;
+					continue;
+				}
+				run = valid;
+				memcpy(S(tileset_pointer) + ((size_t) tile << 4), src, (size_t) run << 4);
+				commit_run(p3, tile, run);
+			}
+			if (out_of_range)
+				set_last_error("p3_write_tiles(): tiles out of range");
+		} else {
+			set_last_error("p3_write_tiles(): tileset is read-only");
 		}
 	} else {
 		set_last_error("p3_write_tiles(): bad 'tiles' argument");